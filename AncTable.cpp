@@ -0,0 +1,142 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "AncTable.h"
+#include <cstdio>
+#include <cstring>
+
+using namespace VioApi;
+
+AncTable::AncTable()
+: myEntries{}, myNumEntries(0), myCustomList{}
+{
+	addEntry(vANC_CameraMatrix);
+	addEntry(vANC_ProjectionMatrix);
+}
+
+void
+AncTable::setCustomFourCCs(const char *list)
+{
+	char newList[sizeof(myCustomList)];
+	snprintf(newList, sizeof(newList), "%s", list ? list : "");
+
+	if (strcmp(newList, myCustomList) == 0)
+		return;
+
+	memcpy(myCustomList, newList, sizeof(myCustomList));
+
+	// Keep the two built in entries and rebuild the custom ones
+	myNumEntries = 2;
+
+	const char *token = myCustomList;
+	while (*token)
+	{
+		while (*token == ' ' || *token == ',')
+			token++;
+
+		const char *tokenEnd = token;
+		while (*tokenEnd && *tokenEnd != ' ' && *tokenEnd != ',')
+			tokenEnd++;
+
+		// Only exact four character codes are accepted
+		if (tokenEnd - token == 4)
+		{
+			vuint fourcc = vFOURCC(token[0], token[1], token[2], token[3]);
+			bool known = false;
+			for (int i = 0; i < myNumEntries; i++)
+			{
+				known = known || myEntries[i].fourcc == fourcc;
+			}
+			if (!known)
+				addEntry(fourcc);
+		}
+
+		token = tokenEnd;
+	}
+}
+
+void
+AncTable::drain(vHandle handle)
+{
+	for (int i = 0; i < myNumEntries; i++)
+	{
+		Entry &entry = myEntries[i];
+
+		// Removing index 0 until nothing is found walks every blob with this
+		// FOURCC. If several were attached the last one wins. Entries that
+		// receive nothing this frame hold their previous values.
+		void *buffer = nullptr;
+		int size = 0;
+		while (vAncFromVentuz(handle, entry.fourcc, 0, &buffer, &size, true) == VE_Ok)
+		{
+			int count = size / static_cast<int>(sizeof(float));
+			if (count > MaxValues)
+				count = MaxValues;
+
+			memcpy(entry.values, buffer, count * sizeof(float));
+			entry.count = count;
+		}
+	}
+}
+
+int
+AncTable::getNumChannels() const
+{
+	int channels = 0;
+	for (int i = 0; i < myNumEntries; i++)
+	{
+		channels += myEntries[i].count;
+	}
+	return channels;
+}
+
+void
+AncTable::getChannel(int index, const char **name, float *value) const
+{
+	for (int i = 0; i < myNumEntries; i++)
+	{
+		const Entry &entry = myEntries[i];
+		if (index < entry.count)
+		{
+			*name = entry.names[index];
+			*value = entry.values[index];
+			return;
+		}
+		index -= entry.count;
+	}
+}
+
+void
+AncTable::addEntry(vuint fourcc)
+{
+	if (myNumEntries == MaxEntries)
+		return;
+
+	Entry &entry = myEntries[myNumEntries++];
+	entry.fourcc = fourcc;
+	entry.count = 0;
+
+	// Channel names are built once here, e.g. CAMR0 .. CAMR15
+	char code[5] = {
+		static_cast<char>(fourcc & 255),
+		static_cast<char>((fourcc >> 8) & 255),
+		static_cast<char>((fourcc >> 16) & 255),
+		static_cast<char>((fourcc >> 24) & 255),
+		0
+	};
+	for (int i = 0; i < MaxValues; i++)
+	{
+		snprintf(entry.names[i], sizeof(entry.names[i]), "%s%d", code, i);
+	}
+}
@@ -0,0 +1,55 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef AncTable_h
+#define AncTable_h
+
+#include "inc/VioApi.h"
+
+class AncTable
+{
+	/*
+	 Anc blobs received from Ventuz, indexed by FOURCC. The camera and
+	 projection matrices are always registered, custom FOURCCs can be added.
+	 All storage is fixed size so draining a frame never allocates.
+	 Payloads are read as 32-bit floats.
+	 */
+public:
+	static const int MaxEntries = 8;
+	static const int MaxValues = 16;
+
+	AncTable();
+	AncTable(const AncTable&) = delete;
+	AncTable& operator=(const AncTable&) = delete;
+	void setCustomFourCCs(const char *list);
+	void drain(VioApi::vHandle handle);
+	int getNumChannels() const;
+	void getChannel(int index, const char **name, float *value) const;
+private:
+	void addEntry(VioApi::vuint fourcc);
+
+	struct Entry
+	{
+		VioApi::vuint	fourcc;
+		int				count;
+		float			values[MaxValues];
+		char			names[MaxValues][8];
+	};
+
+	Entry myEntries[MaxEntries];
+	int myNumEntries;
+	char myCustomList[64];
+};
+
+#endif /* AncTable_h */
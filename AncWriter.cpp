@@ -0,0 +1,118 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "AncWriter.h"
+
+using namespace VioApi;
+
+AncWriter::AncWriter()
+: myBlobs{}, myNumBlobs(0), myNumSent(0), myNumDropped(0), myNumUnpacked(0), myUsed(0)
+{
+}
+
+void
+AncWriter::reset()
+{
+	// The buffer keeps its capacity, so once it has grown to the largest
+	// frame seen packing doesn't allocate any more
+	myNumBlobs = 0;
+	myNumSent = 0;
+	myNumDropped = 0;
+	myNumUnpacked = 0;
+	myUsed = 0;
+}
+
+float *
+AncWriter::addBlob(vuint fourcc, int numFloats)
+{
+	if (myNumBlobs == MaxBlobs || numFloats <= 0)
+	{
+		myNumUnpacked++;
+		return nullptr;
+	}
+
+	if (myBuffer.size() < myUsed + numFloats)
+	{
+		myBuffer.resize(myUsed + numFloats);
+	}
+
+	Blob &blob = myBlobs[myNumBlobs++];
+	blob.fourcc = fourcc;
+	blob.offset = myUsed;
+	blob.numFloats = numFloats;
+
+	myUsed += numFloats;
+
+	// Only valid until the next addBlob(), which may grow the buffer
+	return &myBuffer[blob.offset];
+}
+
+void
+AncWriter::addDropped(int count)
+{
+	// Blobs a packer couldn't even offer, counted like the ones addBlob()
+	// turns away
+	myNumUnpacked += count;
+}
+
+vError
+AncWriter::submit(vHandle handle)
+{
+	vError result = VE_Ok;
+
+	// A frame sent twice submits the same blobs again, the counts are
+	// for the latest submit only
+	myNumSent = 0;
+	myNumDropped = 0;
+
+	for (int i = 0; i < myNumBlobs; i++)
+	{
+		const Blob &blob = myBlobs[i];
+		vError error = vAncToVentuz(handle, blob.fourcc, &myBuffer[blob.offset],
+									blob.numFloats * static_cast<int>(sizeof(float)));
+		if (error != VE_Ok)
+		{
+			// Once VIO overflows nothing after this blob fits either
+			myNumDropped += myNumBlobs - i;
+			result = error;
+			break;
+		}
+		myNumSent++;
+	}
+
+	return result;
+}
+
+int
+AncWriter::getNumBlobs() const
+{
+	return myNumSent;
+}
+
+int
+AncWriter::getNumBytes() const
+{
+	int bytes = 0;
+	for (int i = 0; i < myNumSent && i < myNumBlobs; i++)
+	{
+		bytes += myBlobs[i].numFloats * static_cast<int>(sizeof(float));
+	}
+	return bytes;
+}
+
+int
+AncWriter::getNumDropped() const
+{
+	return myNumUnpacked + myNumDropped;
+}
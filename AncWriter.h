@@ -0,0 +1,58 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef AncWriter_h
+#define AncWriter_h
+
+#include "inc/VioApi.h"
+#include <vector>
+
+class AncWriter
+{
+	/*
+	 Packs the anc blobs sent with one frame into a single buffer that is
+	 reused from frame to frame. VIO doesn't copy anc data, so the buffer
+	 must not change between submit() and unlocking the frame.
+	 */
+public:
+	static const int MaxBlobs = 32;
+
+	AncWriter();
+	AncWriter(const AncWriter&) = delete;
+	AncWriter& operator=(const AncWriter&) = delete;
+	void reset();
+	float *addBlob(VioApi::vuint fourcc, int numFloats);
+	void addDropped(int count);
+	VioApi::vError submit(VioApi::vHandle handle);
+	int getNumBlobs() const;
+	int getNumBytes() const;
+	int getNumDropped() const;
+private:
+	struct Blob
+	{
+		VioApi::vuint	fourcc;
+		size_t			offset;
+		int				numFloats;
+	};
+
+	std::vector<float> myBuffer;
+	Blob myBlobs[MaxBlobs];
+	int myNumBlobs;
+	int myNumSent;
+	int myNumDropped;
+	int myNumUnpacked;
+	size_t myUsed;
+};
+
+#endif /* AncWriter_h */
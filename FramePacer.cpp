@@ -0,0 +1,165 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#include "FramePacer.h"
+
+using namespace VioApi;
+
+// Weight of the newest lock wait in its running average
+static const double WaitSmoothing = 0.1;
+
+// Locking moves after drawing once it waits longer than this part of a
+// frame, and back once it drops below the lower one
+static const double LockLateAbove = 0.25;
+static const double LockEarlyBelow = 0.1;
+
+FramePacer::FramePacer()
+: myPhase(0.0), myFrameMilliseconds(0.0), myLockWait(0.0), myLockLate(false),
+	mySkipped(0), myRepeated(0), myFirstDropCount(-1), myDropCount(0),
+	myLocked(false), myUseClusterClock(false), myFirstClock(0), myLastClock(0), mySent(0)
+{
+}
+
+void
+FramePacer::reset()
+{
+	myPhase = 0.0;
+	myFrameMilliseconds = 0.0;
+	myLockWait = 0.0;
+	myLockLate = false;
+	mySkipped = 0;
+	myRepeated = 0;
+	myFirstDropCount = -1;
+	myDropCount = 0;
+	myLocked = false;
+	myUseClusterClock = false;
+	myFirstClock = 0;
+	myLastClock = 0;
+	mySent = 0;
+}
+
+int
+FramePacer::beginCook(const vInfo &info)
+{
+	myCookTime = std::chrono::steady_clock::now();
+
+	// Only a synchronous stream with a known rate can be paced, anything
+	// else gets a frame every cook
+	if (!info.Synchrone || info.FrameRateNum <= 0 || info.FrameRateDen <= 0)
+	{
+		myFrameMilliseconds = 0.0;
+		myPhase = 0.0;
+		return 1;
+	}
+
+	myFrameMilliseconds = 1000.0 * info.FrameRateDen / info.FrameRateNum;
+
+	// Until a frame has been locked there is no clock to compare with
+	if (!myLocked)
+		return 1;
+
+	// Where Ventuz's clock is now, carried on from the last lock at its
+	// frame rate, against the frame this cook would send
+	double sinceLock = std::chrono::duration<double, std::milli>(myCookTime - myLastLockTime).count();
+	double clock = static_cast<double>(myLastClock - myFirstClock) + sinceLock / myFrameMilliseconds;
+	myPhase = clock - static_cast<double>(mySent);
+
+	// Ventuz got a frame ahead, the picture goes out twice to catch up
+	if (myPhase >= 1.0)
+	{
+		myRepeated++;
+		return 2;
+	}
+
+	// We got a frame ahead, this cook sends nothing rather than stall
+	if (myPhase <= -1.0)
+	{
+		mySkipped++;
+		return 0;
+	}
+	return 1;
+}
+
+void
+FramePacer::frameLocked(const vFrame &frame, double waitMilliseconds)
+{
+	// The lock returns once Ventuz takes the frame, so its clock belongs
+	// to when the wait ended
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if (!myLocked)
+	{
+		myLocked = true;
+		myUseClusterClock = frame.ClusterClock != 0;
+		myFirstClock = myUseClusterClock ? frame.ClusterClock : frame.FrameCount;
+		myFirstDropCount = frame.DropCount;
+		mySent = 0;
+	}
+
+	// The frame just locked is the one sent at this clock
+	myLastClock = myUseClusterClock ? frame.ClusterClock : frame.FrameCount;
+	myLastLockTime = now;
+	mySent++;
+
+	// Ventuz's own count of frames it had to drop, from when pacing began
+	myDropCount = frame.DropCount - myFirstDropCount;
+
+	myLockWait += (waitMilliseconds - myLockWait) * WaitSmoothing;
+
+	if (myFrameMilliseconds > 0.0)
+	{
+		double waitFrames = myLockWait / myFrameMilliseconds;
+		if (!myLockLate && waitFrames > LockLateAbove)
+			myLockLate = true;
+		else if (myLockLate && waitFrames < LockEarlyBelow)
+			myLockLate = false;
+	}
+}
+
+bool
+FramePacer::getLockLate() const
+{
+	return myLockLate;
+}
+
+double
+FramePacer::getPhaseError() const
+{
+	return myPhase;
+}
+
+double
+FramePacer::getLockWaitMilliseconds() const
+{
+	return myLockWait;
+}
+
+int64_t
+FramePacer::getSkipped() const
+{
+	return mySkipped;
+}
+
+int64_t
+FramePacer::getRepeated() const
+{
+	return myRepeated;
+}
+
+int64_t
+FramePacer::getVentuzDrops() const
+{
+	return myDropCount;
+}
@@ -0,0 +1,72 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#ifndef FramePacer_h
+#define FramePacer_h
+
+#include "inc/VioApi.h"
+#include <chrono>
+#include <cstdint>
+
+class FramePacer
+{
+	/*
+	 Keeps a synchronous VIO stream in step with TouchDesigner's cooks.
+	 Every lock reads Ventuz's clock, and between locks it is carried
+	 forward on the real time each cook starts at. How far that clock got
+	 ahead of the frames sent so far is the phase error, in frames. Once
+	 it reaches a whole frame a cook sends one frame more or one less, so
+	 frames are doubled or dropped at a point we choose and count rather
+	 than wherever the clocks slip.
+	 How long locking waits on Ventuz decides where in the cook the lock
+	 goes: early while it doesn't wait, after drawing once it does, so
+	 the GPU works through the wait.
+	 */
+public:
+	FramePacer();
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+	void reset();
+	int beginCook(const VioApi::vInfo &info);
+	void frameLocked(const VioApi::vFrame &frame, double waitMilliseconds);
+	bool getLockLate() const;
+	double getPhaseError() const;
+	double getLockWaitMilliseconds() const;
+	int64_t getSkipped() const;
+	int64_t getRepeated() const;
+	int64_t getVentuzDrops() const;
+private:
+	double myPhase;
+	double myFrameMilliseconds;
+	double myLockWait;
+	bool myLockLate;
+	int64_t mySkipped;
+	int64_t myRepeated;
+	int64_t myFirstDropCount;
+	int64_t myDropCount;
+
+	// Ventuz's clock at the first lock and the last one, and the frames
+	// sent in between. The cluster clock is used while Ventuz runs one,
+	// otherwise its frame count.
+	bool myLocked;
+	bool myUseClusterClock;
+	int64_t myFirstClock;
+	int64_t myLastClock;
+	int64_t mySent;
+	std::chrono::steady_clock::time_point myCookTime;
+	std::chrono::steady_clock::time_point myLastLockTime;
+};
+
+#endif /* FramePacer_h */
@@ -0,0 +1,174 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#include "GLState.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#endif
+
+GLuint GLState::ourProgram = GLState::Unknown;
+GLuint GLState::ourVertexArray = GLState::Unknown;
+GLuint GLState::ourBuffers[GLState::NumTargets] = { GLState::Unknown, GLState::Unknown, GLState::Unknown };
+GLint GLState::ourViewport[4] = { -1, -1, -1, -1 };
+GLfloat GLState::ourClearColor[4] = { -1.0f, -1.0f, -1.0f, -1.0f };
+int64_t GLState::ourIssued = 0;
+int64_t GLState::ourSkipped = 0;
+
+void
+GLState::invalidate()
+{
+	// Values no call can match, so the next call for each is issued
+	ourProgram = Unknown;
+	ourVertexArray = Unknown;
+	for (int i = 0; i < NumTargets; i++)
+	{
+		ourBuffers[i] = Unknown;
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		ourViewport[i] = -1;
+		ourClearColor[i] = -1.0f;
+	}
+}
+
+void
+GLState::restore()
+{
+	// Only bindings we set are put back, anything still unknown was left
+	// as it was. TouchDesigner sets its own viewport and clear color
+	// whenever it needs them.
+	if (ourProgram != Unknown && ourProgram != 0)
+		useProgram(0);
+	if (ourVertexArray != Unknown && ourVertexArray != 0)
+		bindVertexArray(0);
+
+	const GLenum targets[NumTargets] = { GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_COPY_WRITE_BUFFER };
+	for (int i = 0; i < NumTargets; i++)
+	{
+		if (ourBuffers[i] != Unknown && ourBuffers[i] != 0)
+			bindBuffer(targets[i], 0);
+	}
+
+	invalidate();
+}
+
+void
+GLState::useProgram(GLuint program)
+{
+	if (track(program != ourProgram))
+	{
+		glUseProgram(program);
+		ourProgram = program;
+	}
+}
+
+void
+GLState::bindVertexArray(GLuint vao)
+{
+	if (track(vao != ourVertexArray))
+	{
+		glBindVertexArray(vao);
+		ourVertexArray = vao;
+	}
+}
+
+void
+GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index;
+	if (target == GL_ARRAY_BUFFER)
+		index = ArrayBuffer;
+	else if (target == GL_UNIFORM_BUFFER)
+		index = UniformBuffer;
+	else if (target == GL_COPY_WRITE_BUFFER)
+		index = CopyWriteBuffer;
+	else
+	{
+		// The element array binding belongs to the bound vertex array
+		ourIssued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (track(buffer != ourBuffers[index]))
+	{
+		glBindBuffer(target, buffer);
+		ourBuffers[index] = buffer;
+	}
+}
+
+void
+GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	bool changed = x != ourViewport[0] || y != ourViewport[1] ||
+					width != ourViewport[2] || height != ourViewport[3];
+	if (track(changed))
+	{
+		glViewport(x, y, width, height);
+		ourViewport[0] = x;
+		ourViewport[1] = y;
+		ourViewport[2] = width;
+		ourViewport[3] = height;
+	}
+}
+
+void
+GLState::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+	bool changed = r != ourClearColor[0] || g != ourClearColor[1] ||
+					b != ourClearColor[2] || a != ourClearColor[3];
+	if (track(changed))
+	{
+		glClearColor(r, g, b, a);
+		ourClearColor[0] = r;
+		ourClearColor[1] = g;
+		ourClearColor[2] = b;
+		ourClearColor[3] = a;
+	}
+}
+
+void
+GLState::forgetBuffer(GLuint buffer)
+{
+	// Deleting a bound buffer unbinds it, and its name may be handed out
+	// again by the next glGenBuffers()
+	for (int i = 0; i < NumTargets; i++)
+	{
+		if (ourBuffers[i] == buffer)
+			ourBuffers[i] = 0;
+	}
+}
+
+int64_t
+GLState::getIssued()
+{
+	return ourIssued;
+}
+
+int64_t
+GLState::getSkipped()
+{
+	return ourSkipped;
+}
+
+bool
+GLState::track(bool changed)
+{
+	if (changed)
+		ourIssued++;
+	else
+		ourSkipped++;
+	return changed;
+}
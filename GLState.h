@@ -0,0 +1,66 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#ifndef GLState_h
+#define GLState_h
+
+#include "TOP_CPlusPlusBase.h"
+
+class GLState
+{
+	/*
+	 Remembers the program, vertex array, buffer bindings, viewport and
+	 clear color last set, and skips calls that wouldn't change them.
+	 Nothing is known about the context outside our own calls, so a cook
+	 calls invalidate() right after beginGLCommands() and restore() before
+	 endGLCommands(), which puts the bindings it changed back to 0. Calls into VIO,
+	 which uses the context too, are wrapped the same way. Buffer targets
+	 other than the ones tracked here are passed straight through.
+	 */
+public:
+	static void invalidate();
+	static void restore();
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vao);
+	static void bindBuffer(GLenum target, GLuint buffer);
+	static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	static void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+	static void forgetBuffer(GLuint buffer);
+	static int64_t getIssued();
+	static int64_t getSkipped();
+private:
+	enum Target
+	{
+		ArrayBuffer,
+		UniformBuffer,
+		CopyWriteBuffer,
+		NumTargets
+	};
+
+	// No name GL hands out
+	static const GLuint Unknown = ~0u;
+
+	static bool track(bool changed);
+
+	static GLuint ourProgram;
+	static GLuint ourVertexArray;
+	static GLuint ourBuffers[NumTargets];
+	static GLint ourViewport[4];
+	static GLfloat ourClearColor[4];
+	static int64_t ourIssued;
+	static int64_t ourSkipped;
+};
+
+#endif /* GLState_h */
@@ -0,0 +1,117 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "GpuTimer.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#endif
+
+static const char *phaseNames[GpuTimer::NumPhases] = {
+	"gpuClearMs",
+	"gpuSceneMs",
+	"gpuVioCopyMs"
+};
+
+GpuTimer::GpuTimer()
+: myQueries{}, myIssued{}, myMilliseconds{}, myBuffer(0), mySupported(false),
+	myActive(false)
+{
+}
+
+GpuTimer::~GpuTimer()
+{
+	if (myQueries[0][0])
+	{
+		glDeleteQueries(2 * NumPhases, &myQueries[0][0]);
+	}
+}
+
+void
+GpuTimer::setup()
+{
+#ifdef _WIN32
+	// Timer queries are core in 3.3, but a driver may still expose
+	// them through the extension only
+	mySupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+#else
+	mySupported = true;
+#endif
+
+	if (mySupported && myQueries[0][0] == 0)
+	{
+		glGenQueries(2 * NumPhases, &myQueries[0][0]);
+	}
+}
+
+void
+GpuTimer::begin(Phase phase)
+{
+	// Only the first use of a phase in a frame is measured
+	if (!mySupported || myActive || myIssued[myBuffer][phase])
+		return;
+
+	glBeginQuery(GL_TIME_ELAPSED, myQueries[myBuffer][phase]);
+	myIssued[myBuffer][phase] = true;
+	myActive = true;
+}
+
+void
+GpuTimer::end()
+{
+	if (!myActive)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	myActive = false;
+}
+
+void
+GpuTimer::endFrame()
+{
+	if (!mySupported)
+		return;
+
+	// Collect what the previous frame issued. If the GPU hasn't finished
+	// with it yet we keep the last value rather than waiting.
+	int previous = 1 - myBuffer;
+	for (int i = 0; i < NumPhases; i++)
+	{
+		if (!myIssued[previous][i])
+			continue;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(myQueries[previous][i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(myQueries[previous][i], GL_QUERY_RESULT, &nanoseconds);
+			myMilliseconds[i] = static_cast<double>(nanoseconds) / 1.0e6;
+		}
+		myIssued[previous][i] = false;
+	}
+
+	myBuffer = previous;
+}
+
+double
+GpuTimer::getMilliseconds(Phase phase) const
+{
+	return myMilliseconds[phase];
+}
+
+const char *
+GpuTimer::getPhaseName(Phase phase)
+{
+	return phaseNames[phase];
+}
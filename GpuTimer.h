@@ -0,0 +1,55 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef GpuTimer_h
+#define GpuTimer_h
+
+#include "TOP_CPlusPlusBase.h"
+
+class GpuTimer
+{
+	/*
+	 GL_TIME_ELAPSED queries for each phase of a frame. Queries are double
+	 buffered and read back one frame after they were issued, so reading a
+	 result never stalls on the GPU.
+	 */
+public:
+	enum Phase
+	{
+		Clear,
+		DrawScene,
+		VioCopy,
+		NumPhases
+	};
+
+	GpuTimer();
+	~GpuTimer();
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+	void setup();
+	void begin(Phase phase);
+	void end();
+	void endFrame();
+	double getMilliseconds(Phase phase) const;
+	static const char *getPhaseName(Phase phase);
+private:
+	GLuint myQueries[2][NumPhases];
+	bool myIssued[2][NumPhases];
+	double myMilliseconds[NumPhases];
+	int myBuffer;
+	bool mySupported;
+	bool myActive;
+};
+
+#endif /* GpuTimer_h */
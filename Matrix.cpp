@@ -13,20 +13,65 @@
 */
 
 #include "Matrix.h"
+#include <cmath>
 
-Matrix::Matrix()
-: matrix{1.0, 0.0, 0.0, 0.0,
-	0.0, 1.0, 0.0, 0.0,
-	0.0, 0.0, 1.0, 0.0,
-	0.0, 0.0, 0.0, 1.0}
+// Use SSE on x86 and NEON on ARM, both always present on the 64 bit
+// targets we build for. Anything else gets the scalar version.
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MATRIX_SSE
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MATRIX_NEON
+#endif
+
+Matrix
+Matrix::rotateTranslateScale(GLfloat radians, GLfloat x, GLfloat y, GLfloat sx, GLfloat sy)
 {
+	GLfloat c = std::cos(radians);
+	GLfloat s = std::sin(radians);
 
+	return Matrix(c * sx, s * sx, 0.0f, x * sx,
+				-s * sy, c * sy, 0.0f, y * sy,
+				0.0f, 0.0f, 1.0f, 0.0f,
+				0.0f, 0.0f, 0.0f, 1.0f);
 }
 
+// Each column of the result is the columns of a weighted by that column
+// of b, so every path works four floats at a time.
 Matrix operator*(const Matrix &a, const Matrix &b)
 {
 	Matrix result;
 
+#if defined(MATRIX_SSE)
+	__m128 a0 = _mm_load_ps(a.matrix);
+	__m128 a1 = _mm_load_ps(a.matrix + 4);
+	__m128 a2 = _mm_load_ps(a.matrix + 8);
+	__m128 a3 = _mm_load_ps(a.matrix + 12);
+
+	for (int c = 0; c < 16; c += 4)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[c]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[c + 1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[c + 2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[c + 3])));
+		_mm_store_ps(result.matrix + c, column);
+	}
+#elif defined(MATRIX_NEON)
+	float32x4_t a0 = vld1q_f32(a.matrix);
+	float32x4_t a1 = vld1q_f32(a.matrix + 4);
+	float32x4_t a2 = vld1q_f32(a.matrix + 8);
+	float32x4_t a3 = vld1q_f32(a.matrix + 12);
+
+	for (int c = 0; c < 16; c += 4)
+	{
+		float32x4_t column = vmulq_n_f32(a0, b[c]);
+		column = vmlaq_n_f32(column, a1, b[c + 1]);
+		column = vmlaq_n_f32(column, a2, b[c + 2]);
+		column = vmlaq_n_f32(column, a3, b[c + 3]);
+		vst1q_f32(result.matrix + c, column);
+	}
+#else
 	result[ 0] = a[ 0] * b[ 0] + a[ 4] * b[ 1] + a[ 8] * b[ 2] + a[12] * b[ 3];
 	result[ 1] = a[ 1] * b[ 0] + a[ 5] * b[ 1] + a[ 9] * b[ 2] + a[13] * b[ 3];
 	result[ 2] = a[ 2] * b[ 0] + a[ 6] * b[ 1] + a[10] * b[ 2] + a[14] * b[ 3];
@@ -46,6 +91,7 @@ Matrix operator*(const Matrix &a, const Matrix &b)
 	result[13] = a[ 1] * b[12] + a[ 5] * b[13] + a[ 9] * b[14] + a[13] * b[15];
 	result[14] = a[ 2] * b[12] + a[ 6] * b[13] + a[10] * b[14] + a[14] * b[15];
 	result[15] = a[ 3] * b[12] + a[ 7] * b[13] + a[11] * b[14] + a[15] * b[15];
+#endif
 
 	return result;
 }
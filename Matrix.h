@@ -18,9 +18,34 @@
 #include "TOP_CPlusPlusBase.h"
 
 class Matrix {
+	/*
+	 A 4x4 matrix stored column by column, as glUniformMatrix4fv takes it
+	 without transposing. The constructors are constexpr, so constant
+	 matrices cost nothing at runtime.
+	 */
 public:
-	Matrix();
-	GLfloat matrix[16];
+	constexpr Matrix()
+	: matrix{1.0, 0.0, 0.0, 0.0,
+		0.0, 1.0, 0.0, 0.0,
+		0.0, 0.0, 1.0, 0.0,
+		0.0, 0.0, 0.0, 1.0}
+	{
+	}
+
+	constexpr Matrix(GLfloat m0, GLfloat m1, GLfloat m2, GLfloat m3,
+					GLfloat m4, GLfloat m5, GLfloat m6, GLfloat m7,
+					GLfloat m8, GLfloat m9, GLfloat m10, GLfloat m11,
+					GLfloat m12, GLfloat m13, GLfloat m14, GLfloat m15)
+	: matrix{m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15}
+	{
+	}
+
+	// The same as rotate * translate(x, y) * scale(sx, sy), with the
+	// rotation about Z, built directly instead of with two multiplies
+	static Matrix rotateTranslateScale(GLfloat radians, GLfloat x, GLfloat y,
+										GLfloat sx, GLfloat sy);
+
+	alignas(16) GLfloat matrix[16];
 	GLfloat operator[](int i) const
 	{
 		return matrix[i];
@@ -13,103 +13,335 @@
 */
 
 #include "Program.h"
+#include "ProgramCache.h"
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
 #endif
 
+#include <cctype>
+#include <cstdlib>
+#include <vector>
+
 static const char *compileError = "A shader could not be compiled.";
 static const char *linkError = "A shader could not be linked.";
 
-Program::Program()
-: myProgram(0)
+// GL_COMPLETION_STATUS_KHR, the same value as the ARB version
+static const GLenum CompletionStatus = 0x91B1;
+
+// Source lines quoted in the log are cut to this length
+static const size_t MaxQuoteLength = 120;
+
+// Lets the driver compile and link on its own threads, and answer whether
+// it has finished without blocking
+static bool
+supportsParallelCompile()
 {
+#ifdef _WIN32
+	return GLEW_ARB_parallel_shader_compile || glewIsSupported("GL_KHR_parallel_shader_compile");
+#else
+	return false;
+#endif
 }
 
-Program::~Program()
+static std::string
+shaderInfoLog(GLuint shader)
 {
-	if (myProgram)
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	if (length <= 1)
+		return std::string();
+
+	std::vector<GLchar> log(length);
+	glGetShaderInfoLog(shader, length, nullptr, log.data());
+	return std::string(log.data());
+}
+
+static std::string
+programInfoLog(GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	if (length <= 1)
+		return std::string();
+
+	std::vector<GLchar> log(length);
+	glGetProgramInfoLog(program, length, nullptr, log.data());
+	return std::string(log.data());
+}
+
+// Finds the source line a log message refers to. Drivers write it as
+// "0(12)" (NVIDIA), "0:12:" (AMD, Intel, Apple) or "0:12(5)" (Mesa),
+// always after the source string index. Returns 0 when there is none.
+static int
+logSourceLine(const std::string &message)
+{
+	size_t i = 0;
+	while (i < message.size())
 	{
-		glDeleteProgram(myProgram);
-		myProgram = 0;
+		if (!isdigit(static_cast<unsigned char>(message[i])))
+		{
+			i++;
+			continue;
+		}
+
+		// Skip the source string index
+		while (i < message.size() && isdigit(static_cast<unsigned char>(message[i])))
+		{
+			i++;
+		}
+		if (i + 1 < message.size() && (message[i] == '(' || message[i] == ':') &&
+			isdigit(static_cast<unsigned char>(message[i + 1])))
+		{
+			return atoi(message.c_str() + i + 1);
+		}
 	}
+	return 0;
 }
 
-const char * Program::build(const char *vertex, const char *fragment)
+Program::Program()
+: myProgram(0), myVertexShader(0), myFragmentShader(0), myState(Empty),
+	myCacheable(false), myParallel(false), myBuildMilliseconds(0.0)
 {
-	const char *error = nullptr;
-	GLuint vertexShader = 0, fragmentShader = 0;
+}
 
-	if (myProgram)
+Program::~Program()
+{
+	release();
+}
+
+void
+Program::submit(const char *vertex, const char *fragment)
+{
+	release();
+
+	myVertexSource = vertex;
+	myFragmentSource = fragment;
+	myError.clear();
+	myLog.clear();
+
+	// A binary built earlier skips compiling and linking altogether
+	myCacheable = ProgramCache::isSupported();
+	if (myCacheable)
 	{
+		myProgram = glCreateProgram();
+		if (ProgramCache::load(myProgram, vertex, fragment))
+		{
+			myState = Ready;
+			return;
+		}
+
 		glDeleteProgram(myProgram);
 		myProgram = 0;
 	}
 
-	vertexShader = compileShader(vertex, GL_VERTEX_SHADER, &error);
-	if (error == nullptr)
+	myParallel = supportsParallelCompile();
+#ifdef _WIN32
+	if (myParallel && GLEW_ARB_parallel_shader_compile)
 	{
-		fragmentShader = compileShader(fragment, GL_FRAGMENT_SHADER, &error);
+		// Let the driver use as many threads as it likes
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
 	}
+#endif
 
-	if (error == nullptr)
-	{
-		myProgram = glCreateProgram();
-		glAttachShader(myProgram, vertexShader);
-		glAttachShader(myProgram, fragmentShader);
-	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-	if (vertexShader)
-	{
-		glDeleteShader(vertexShader);
-	}
-	if (fragmentShader)
+	// No status is queried until poll(), any query would wait for the
+	// compile. A shader that fails to compile makes the link fail.
+	myVertexShader = createShader(vertex, GL_VERTEX_SHADER);
+	myFragmentShader = createShader(fragment, GL_FRAGMENT_SHADER);
+
+	myProgram = glCreateProgram();
+	glAttachShader(myProgram, myVertexShader);
+	glAttachShader(myProgram, myFragmentShader);
+
+	if (myCacheable)
 	{
-		glDeleteShader(fragmentShader);
+		glProgramParameteri(myProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	}
 
-	if (error == nullptr)
-	{
-		glLinkProgram(myProgram);
+	glLinkProgram(myProgram);
+	myState = Pending;
 
-		GLint status;
-		glGetProgramiv(myProgram, GL_LINK_STATUS, &status);
-		if (status == GL_FALSE)
+	myBuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+Program::State
+Program::poll()
+{
+	if (myState != Pending)
+		return myState;
+
+	// Only the time spent in here counts towards the build, with parallel
+	// compile the cooks in between don't wait on it
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// Without parallel compile the status query in finish() blocks until
+	// the driver is done
+	if (myParallel)
+	{
+		GLint done = GL_FALSE;
+		glGetProgramiv(myProgram, CompletionStatus, &done);
+		if (!done)
 		{
-			error = linkError;
-			glDeleteProgram(myProgram);
-			myProgram = 0;
+			myBuildMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return myState;
 		}
 	}
 
-	return error;
+	finish(start);
+	return myState;
+}
+
+Program::State
+Program::getState() const
+{
+	return myState;
+}
+
+const char *
+Program::getError() const
+{
+	return myError.empty() ? nullptr : myError.c_str();
+}
+
+const char *
+Program::getLog() const
+{
+	return myLog.c_str();
 }
 
 GLuint
 Program::getName() const
 {
-	return myProgram;
+	return myState == Ready ? myProgram : 0;
 }
 
-GLuint
-Program::compileShader(const char *source, GLenum type, const char **error)
+void
+Program::finish(std::chrono::steady_clock::time_point start)
 {
-	GLuint shader = glCreateShader(type);
-	glShaderSource(shader, 1, &source, nullptr);
-	glCompileShader(shader);
+	// Read once here, warnings are kept for a program that did link
+	appendLog(myLog, "Vertex shader", shaderInfoLog(myVertexShader), myVertexSource);
+	appendLog(myLog, "Fragment shader", shaderInfoLog(myFragmentShader), myFragmentSource);
+	appendLog(myLog, "Link", programInfoLog(myProgram), std::string());
 
 	GLint status;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	glGetProgramiv(myProgram, GL_LINK_STATUS, &status);
 	if (status == GL_FALSE)
 	{
-		*error = compileError;
+		GLint vertexStatus;
+		GLint fragmentStatus;
+		glGetShaderiv(myVertexShader, GL_COMPILE_STATUS, &vertexStatus);
+		glGetShaderiv(myFragmentShader, GL_COMPILE_STATUS, &fragmentStatus);
+		myError = vertexStatus == GL_FALSE || fragmentStatus == GL_FALSE ? compileError : linkError;
+		if (!myLog.empty())
+		{
+			myError.push_back('\n');
+			myError.append(myLog);
+		}
 
-		glDeleteShader(shader);
-		shader = 0;
+		glDeleteProgram(myProgram);
+		myProgram = 0;
+		myState = Failed;
 	}
 	else
 	{
-		*error = nullptr;
+		myState = Ready;
+
+		// The time recorded is what cooks spent building, the wait a
+		// cached binary saves
+		if (myCacheable)
+		{
+			myBuildMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			ProgramCache::store(myProgram, myVertexSource.c_str(), myFragmentSource.c_str(), myBuildMilliseconds);
+		}
 	}
 
+	glDeleteShader(myVertexShader);
+	glDeleteShader(myFragmentShader);
+	myVertexShader = 0;
+	myFragmentShader = 0;
+}
+
+void
+Program::release()
+{
+	if (myProgram)
+	{
+		glDeleteProgram(myProgram);
+		myProgram = 0;
+	}
+	if (myVertexShader)
+	{
+		glDeleteShader(myVertexShader);
+		myVertexShader = 0;
+	}
+	if (myFragmentShader)
+	{
+		glDeleteShader(myFragmentShader);
+		myFragmentShader = 0;
+	}
+	myState = Empty;
+}
+
+void
+Program::appendLog(std::string &log, const char *title, const std::string &messages,
+					const std::string &source)
+{
+	if (messages.empty())
+		return;
+
+	if (!log.empty())
+		log.push_back('\n');
+	log.append(title);
+	log.append(":\n");
+
+	size_t start = 0;
+	while (start < messages.size())
+	{
+		size_t end = messages.find('\n', start);
+		if (end == std::string::npos)
+			end = messages.size();
+
+		std::string message = messages.substr(start, end - start);
+		start = end + 1;
+		if (message.empty())
+			continue;
+
+		log.append(message);
+		log.push_back('\n');
+
+		// Quote the line of the user's source the message is about
+		int line = source.empty() ? 0 : logSourceLine(message);
+		if (line > 0)
+		{
+			size_t lineStart = 0;
+			for (int i = 1; i < line && lineStart != std::string::npos; i++)
+			{
+				lineStart = source.find('\n', lineStart);
+				if (lineStart != std::string::npos)
+					lineStart++;
+			}
+
+			if (lineStart != std::string::npos && lineStart < source.size())
+			{
+				size_t lineEnd = source.find('\n', lineStart);
+				size_t length = (lineEnd == std::string::npos ? source.size() : lineEnd) - lineStart;
+
+				log.append("    ");
+				log.append(source, lineStart, length < MaxQuoteLength ? length : MaxQuoteLength);
+				if (length > MaxQuoteLength)
+					log.append("...");
+				log.push_back('\n');
+			}
+		}
+	}
+}
+
+GLuint
+Program::createShader(const char *source, GLenum type)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
 	return shader;
 }
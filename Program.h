@@ -16,19 +16,54 @@
 #define Program_h
 
 #include "TOP_CPlusPlusBase.h"
+#include <chrono>
+#include <string>
 
 class Program 
 {
+	/*
+	 A linked vertex and fragment shader. submit() starts building it and
+	 poll() picks up the result once the driver is done, so with parallel
+	 shader compile support a cook never waits on the compiler.
+	 The compiler and linker logs are read once when the build finishes,
+	 with the source line each message refers to quoted under it.
+	 */
 public:
+	enum State
+	{
+		Empty,
+		Pending,
+		Ready,
+		Failed
+	};
+
 	Program();
 	~Program();
 	Program(const Program&) = delete;
 	Program& operator=(const Program&) = delete;
-	const char *build(const char *vertex, const char *fragment);
+	void submit(const char *vertex, const char *fragment);
+	State poll();
+	State getState() const;
+	const char *getError() const;
+	const char *getLog() const;
 	GLuint getName() const;
 private:
-	static GLuint compileShader(const char *source, GLenum type, const char **error);
+	static GLuint createShader(const char *source, GLenum type);
+	static void appendLog(std::string &log, const char *title, const std::string &messages,
+							const std::string &source);
+	void finish(std::chrono::steady_clock::time_point start);
+	void release();
 	GLuint myProgram;
+	GLuint myVertexShader;
+	GLuint myFragmentShader;
+	State myState;
+	std::string myError;
+	std::string myLog;
+	bool myCacheable;
+	bool myParallel;
+	std::string myVertexSource;
+	std::string myFragmentSource;
+	double myBuildMilliseconds;
 };
 
 #endif /* Program_h */
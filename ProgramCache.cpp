@@ -0,0 +1,211 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "ProgramCache.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#include <sys/stat.h>
+#endif
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Written at the start of every cache file
+struct CacheHeader
+{
+	uint32_t	magic;
+	GLenum		format;
+	GLint		length;
+	double		buildMilliseconds;
+};
+
+static const uint32_t CacheMagic = 0x43425056; // "VPBC"
+
+int ProgramCache::ourLookups = 0;
+int ProgramCache::ourHits = 0;
+double ProgramCache::ourMillisecondsSaved = 0.0;
+
+static uint64_t
+hashString(uint64_t hash, const char *string)
+{
+	// FNV-1a, including the terminator so "ab" + "c" differs from "a" + "bc"
+	if (string == nullptr)
+		string = "";
+	do
+	{
+		hash = (hash ^ static_cast<unsigned char>(*string)) * 1099511628211ull;
+	} while (*string++);
+	return hash;
+}
+
+static FILE *
+openFile(const char *path, const char *mode)
+{
+#ifdef _WIN32
+	FILE *file = nullptr;
+	if (fopen_s(&file, path, mode) != 0)
+		return nullptr;
+	return file;
+#else // macOS
+	return fopen(path, mode);
+#endif
+}
+
+bool
+ProgramCache::isSupported()
+{
+#ifdef _WIN32
+	if (!(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+		return false;
+#endif
+	// A driver may support the calls but offer no binary formats
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+bool
+ProgramCache::getPath(const char *vertex, const char *fragment, char *path, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = hashString(hash, vertex);
+	hash = hashString(hash, fragment);
+	hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+	hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+	hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+	char directory[1024];
+#ifdef _WIN32
+	char base[MAX_PATH];
+	DWORD length = GetEnvironmentVariableA("LOCALAPPDATA", base, sizeof(base));
+	if (length == 0 || length >= sizeof(base))
+		return false;
+	snprintf(directory, sizeof(directory), "%s\\VioTOP", base);
+	CreateDirectoryA(directory, nullptr);
+	snprintf(directory, sizeof(directory), "%s\\VioTOP\\ShaderCache", base);
+	CreateDirectoryA(directory, nullptr);
+	snprintf(path, size, "%s\\%016llx.bin", directory, static_cast<unsigned long long>(hash));
+#else // macOS
+	const char *home = getenv("HOME");
+	if (home == nullptr)
+		return false;
+	snprintf(directory, sizeof(directory), "%s/Library/Caches/VioTOP", home);
+	mkdir(directory, 0755);
+	snprintf(directory, sizeof(directory), "%s/Library/Caches/VioTOP/ShaderCache", home);
+	mkdir(directory, 0755);
+	snprintf(path, size, "%s/%016llx.bin", directory, static_cast<unsigned long long>(hash));
+#endif
+	return true;
+}
+
+bool
+ProgramCache::load(GLuint program, const char *vertex, const char *fragment)
+{
+	ourLookups++;
+
+	char path[1200];
+	if (!getPath(vertex, fragment, path, sizeof(path)))
+		return false;
+
+	FILE *file = openFile(path, "rb");
+	if (file == nullptr)
+		return false;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	CacheHeader header;
+	std::vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+					header.magic == CacheMagic && header.length > 0;
+	if (valid)
+	{
+		binary.resize(header.length);
+		valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+
+	if (!valid)
+		return false;
+
+	// The driver may still reject a binary, after an update that kept the
+	// version string for example, the caller then compiles as usual
+	glProgramBinary(program, header.format, binary.data(), header.length);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE)
+		return false;
+
+	double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	ourHits++;
+	if (header.buildMilliseconds > loadMilliseconds)
+		ourMillisecondsSaved += header.buildMilliseconds - loadMilliseconds;
+	return true;
+}
+
+void
+ProgramCache::store(GLuint program, const char *vertex, const char *fragment, double buildMilliseconds)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	CacheHeader header;
+	header.magic = CacheMagic;
+	header.length = 0;
+	header.buildMilliseconds = buildMilliseconds;
+
+	std::vector<char> binary(length);
+	glGetProgramBinary(program, length, &header.length, &header.format, binary.data());
+	if (header.length <= 0)
+		return;
+
+	char path[1200];
+	if (!getPath(vertex, fragment, path, sizeof(path)))
+		return;
+
+	// Failing to write only costs a compile next time
+	FILE *file = openFile(path, "wb");
+	if (file == nullptr)
+		return;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+					fwrite(binary.data(), 1, header.length, file) == static_cast<size_t>(header.length);
+	fclose(file);
+
+	if (!written)
+		remove(path);
+}
+
+int
+ProgramCache::getLookups()
+{
+	return ourLookups;
+}
+
+int
+ProgramCache::getHits()
+{
+	return ourHits;
+}
+
+double
+ProgramCache::getMillisecondsSaved()
+{
+	return ourMillisecondsSaved;
+}
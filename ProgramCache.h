@@ -0,0 +1,45 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef ProgramCache_h
+#define ProgramCache_h
+
+#include "TOP_CPlusPlusBase.h"
+
+class ProgramCache
+{
+	/*
+	 Linked program binaries kept on disk, so a program that has been
+	 built once loads without compiling. Entries are keyed by a hash of the
+	 shader sources and the GL vendor, renderer and version strings, so a
+	 driver update simply misses. The counters cover every program in the
+	 process.
+	 */
+public:
+	static bool isSupported();
+	static bool load(GLuint program, const char *vertex, const char *fragment);
+	static void store(GLuint program, const char *vertex, const char *fragment,
+						double buildMilliseconds);
+	static int getLookups();
+	static int getHits();
+	static double getMillisecondsSaved();
+private:
+	static bool getPath(const char *vertex, const char *fragment, char *path, size_t size);
+
+	static int ourLookups;
+	static int ourHits;
+	static double ourMillisecondsSaved;
+};
+
+#endif /* ProgramCache_h */
@@ -0,0 +1,65 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "RenderTarget.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#endif
+
+RenderTarget::RenderTarget()
+: myFBO(0), myRenderbuffer(0), myWidth(0), myHeight(0), mySamples(1)
+{
+}
+
+RenderTarget::~RenderTarget()
+{
+	if (myFBO)
+	{
+		glDeleteFramebuffers(1, &myFBO);
+		glDeleteRenderbuffers(1, &myRenderbuffer);
+	}
+}
+
+void
+RenderTarget::setup(int width, int height, int samples)
+{
+	if (myFBO == 0)
+	{
+		glGenFramebuffers(1, &myFBO);
+		glGenRenderbuffers(1, &myRenderbuffer);
+	}
+
+	if (width != myWidth || height != myHeight || samples != mySamples)
+	{
+		glBindRenderbuffer(GL_RENDERBUFFER, myRenderbuffer);
+		if (samples > 1)
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		else
+			glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, myFBO);
+		glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, myRenderbuffer);
+
+		myWidth = width;
+		myHeight = height;
+		mySamples = samples;
+	}
+}
+
+GLuint
+RenderTarget::getFBO() const
+{
+	return myFBO;
+}
@@ -0,0 +1,42 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef RenderTarget_h
+#define RenderTarget_h
+
+#include "TOP_CPlusPlusBase.h"
+
+class RenderTarget
+{
+	/*
+	 A framebuffer with a single color renderbuffer, multisampled when asked
+	 for more than one sample. It is reallocated only when its size or
+	 sample count changes.
+	 */
+public:
+	RenderTarget();
+	~RenderTarget();
+	RenderTarget(const RenderTarget&) = delete;
+	RenderTarget& operator=(const RenderTarget&) = delete;
+	void setup(int width, int height, int samples = 1);
+	GLuint getFBO() const;
+private:
+	GLuint myFBO;
+	GLuint myRenderbuffer;
+	int myWidth;
+	int myHeight;
+	int mySamples;
+};
+
+#endif /* RenderTarget_h */
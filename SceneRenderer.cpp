@@ -0,0 +1,159 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "SceneRenderer.h"
+#include "GLState.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#endif
+#include <cstddef>
+#include <cstring>
+
+SceneRenderer::SceneRenderer()
+: myInstanceVBO(0), myModelAttrib(-1), myColorAttrib(-1), myCapacity(0),
+	myNumDraws(0)
+{
+}
+
+SceneRenderer::~SceneRenderer()
+{
+	glDeleteBuffers(1, &myInstanceVBO);
+}
+
+void
+SceneRenderer::setup(GLint modelAttrib, GLint colorAttrib)
+{
+	if (myInstanceVBO == 0)
+	{
+		glGenBuffers(1, &myInstanceVBO);
+	}
+	myModelAttrib = modelAttrib;
+	myColorAttrib = colorAttrib;
+}
+
+void
+SceneRenderer::begin()
+{
+	// Both lists keep their capacity, so a steady scene doesn't allocate
+	myInstances.clear();
+	myBatches.clear();
+}
+
+void
+SceneRenderer::add(const Shape *shape, const Matrix &model, const GLfloat color[4])
+{
+	extendBatch(shape, 1);
+
+	myInstances.emplace_back();
+	Instance &instance = myInstances.back();
+	memcpy(instance.model, model.matrix, sizeof(instance.model));
+	memcpy(instance.color, color, sizeof(instance.color));
+}
+
+void
+SceneRenderer::add(const Shape *shape, const TransformBatch &transforms, const GLfloat color[4])
+{
+	int count = transforms.size();
+	if (count == 0)
+		return;
+
+	extendBatch(shape, count);
+
+	// The matrices are evaluated straight into the instance data
+	size_t first = myInstances.size();
+	myInstances.resize(first + count);
+	transforms.evaluate(myInstances[first].model, sizeof(Instance));
+	for (size_t i = first; i < myInstances.size(); i++)
+	{
+		memcpy(myInstances[i].color, color, sizeof(myInstances[i].color));
+	}
+}
+
+void
+SceneRenderer::draw()
+{
+	myNumDraws = 0;
+	if (myInstances.empty())
+		return;
+
+	// One upload for the whole scene. The buffer is only reallocated when
+	// the scene outgrows it, otherwise the old contents are orphaned so
+	// the upload doesn't wait on the previous frame's draws.
+	size_t bytes = myInstances.size() * sizeof(Instance);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, myInstanceVBO);
+	if (bytes > myCapacity)
+	{
+		myCapacity = bytes;
+	}
+	glBufferData(GL_ARRAY_BUFFER, myCapacity, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, myInstances.data());
+
+	for (const Batch &batch : myBatches)
+	{
+		batch.shape->bindVAO();
+		pointInstanceAttribs(batch.first);
+		batch.shape->drawInstanced(batch.count);
+		myNumDraws++;
+	}
+}
+
+int
+SceneRenderer::getNumInstances() const
+{
+	return static_cast<int>(myInstances.size());
+}
+
+int
+SceneRenderer::getNumDraws() const
+{
+	return myNumDraws;
+}
+
+void
+SceneRenderer::extendBatch(const Shape *shape, int count)
+{
+	if (myBatches.empty() || myBatches.back().shape != shape)
+	{
+		Batch batch;
+		batch.shape = shape;
+		batch.first = static_cast<int>(myInstances.size());
+		batch.count = 0;
+		myBatches.push_back(batch);
+	}
+	myBatches.back().count += count;
+}
+
+void
+SceneRenderer::pointInstanceAttribs(int first)
+{
+	// The instance attributes live in the bound shape's VAO. Pointing them
+	// at the batch's first instance avoids needing base instance support.
+	const GLsizei stride = sizeof(Instance);
+	size_t base = static_cast<size_t>(first) * sizeof(Instance);
+
+	// A mat4 attribute takes four consecutive locations, one per column
+	for (int column = 0; column < 4; column++)
+	{
+		GLuint location = myModelAttrib + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+								reinterpret_cast<const void*>(base + offsetof(Instance, model) + column * 4 * sizeof(GLfloat)));
+		glVertexAttribDivisor(location, 1);
+	}
+
+	glEnableVertexAttribArray(myColorAttrib);
+	glVertexAttribPointer(myColorAttrib, 4, GL_FLOAT, GL_FALSE, stride,
+							reinterpret_cast<const void*>(base + offsetof(Instance, color)));
+	glVertexAttribDivisor(myColorAttrib, 1);
+}
@@ -0,0 +1,71 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef SceneRenderer_h
+#define SceneRenderer_h
+
+#include "TOP_CPlusPlusBase.h"
+#include "Matrix.h"
+#include "Shape.h"
+#include "TransformBatch.h"
+#include <vector>
+
+class SceneRenderer
+{
+	/*
+	 Draws a list of shape instances, each with its own transform and color,
+	 from a single instance buffer. Consecutive instances of the same shape
+	 are drawn with one instanced draw, so add instances grouped by
+	 shape. Instances are layered in the order they were added.
+	 */
+public:
+	SceneRenderer();
+	~SceneRenderer();
+	SceneRenderer(const SceneRenderer&) = delete;
+	SceneRenderer& operator=(const SceneRenderer&) = delete;
+	void setup(GLint modelAttrib, GLint colorAttrib);
+	void begin();
+	void add(const Shape *shape, const Matrix &model, const GLfloat color[4]);
+	void add(const Shape *shape, const TransformBatch &transforms, const GLfloat color[4]);
+	void draw();
+	int getNumInstances() const;
+	int getNumDraws() const;
+private:
+	// Matches the instance attributes, a mat4 followed by a vec4
+	struct Instance
+	{
+		GLfloat		model[16];
+		GLfloat		color[4];
+	};
+
+	struct Batch
+	{
+		const Shape*	shape;
+		int				first;
+		int				count;
+	};
+
+	void extendBatch(const Shape *shape, int count);
+	void pointInstanceAttribs(int first);
+
+	GLuint myInstanceVBO;
+	GLint myModelAttrib;
+	GLint myColorAttrib;
+	std::vector<Instance> myInstances;
+	std::vector<Batch> myBatches;
+	size_t myCapacity;
+	int myNumDraws;
+};
+
+#endif /* SceneRenderer_h */
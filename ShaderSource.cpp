@@ -0,0 +1,168 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#include "ShaderSource.h"
+
+#include <cstdio>
+#include <sys/stat.h>
+
+static const char *fileError = "The shader file could not be read.";
+
+// The file's modification time and size, false when it can't be found.
+// Where the time is only in whole seconds the size also tells apart two
+// saves within the same second.
+static bool
+fileStamp(const char *path, int64_t *modified, int64_t *size)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path, &info) != 0)
+		return false;
+	*modified = static_cast<int64_t>(info.st_mtime);
+#else // macOS
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return false;
+	*modified = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#endif
+	*size = static_cast<int64_t>(info.st_size);
+	return true;
+}
+
+ShaderSource::ShaderSource(const char *builtIn)
+: myBuiltIn(builtIn), myText(), myLoaded(false), myError(nullptr), myDATId(0), myDATCooks(0),
+	myModified(-1), mySize(-1)
+{
+}
+
+bool
+ShaderSource::update(const OP_DATInput *dat, const char *path)
+{
+	// A DAT takes priority over a file
+	if (dat)
+	{
+		if (dat->opId == myDATId && dat->totalCooks == myDATCooks)
+			return false;
+
+		myDATId = dat->opId;
+		myDATCooks = dat->totalCooks;
+		myPath.clear();
+		myError = nullptr;
+
+		// A text DAT has a row per line, a table is read tab separated
+		std::string text;
+		for (int row = 0; row < dat->numRows; row++)
+		{
+			for (int col = 0; col < dat->numCols; col++)
+			{
+				if (col > 0)
+					text.push_back('\t');
+				text.append(dat->getCell(row, col));
+			}
+			text.push_back('\n');
+		}
+
+		return setText(text);
+	}
+
+	myDATId = 0;
+	myDATCooks = 0;
+
+	if (path && path[0])
+	{
+		// Checking the time is a single stat() a cook, the file is only
+		// read when it has been saved since
+		int64_t modified = -1;
+		int64_t size = -1;
+		bool found = fileStamp(path, &modified, &size);
+		if (myPath == path && modified == myModified && size == mySize)
+			return false;
+
+		myPath = path;
+		myModified = modified;
+		mySize = size;
+
+		std::string text;
+		if (!found || !readFile(path, text))
+		{
+			// The last text read is kept, or the built-in one if there is none
+			myError = fileError;
+			if (myLoaded)
+				return false;
+			text = myBuiltIn;
+			return setText(text);
+		}
+
+		myError = nullptr;
+		return setText(text);
+	}
+
+	myPath.clear();
+	myModified = -1;
+	mySize = -1;
+	myError = nullptr;
+
+	std::string text(myBuiltIn);
+	return setText(text);
+}
+
+bool
+ShaderSource::setText(std::string &text)
+{
+	// The first text counts as a change even when it is empty, so an empty
+	// DAT or file still gets built and reports why it doesn't draw
+	if (myLoaded && text == myText)
+		return false;
+	myText.swap(text);
+	myLoaded = true;
+	return true;
+}
+
+const char *
+ShaderSource::getText() const
+{
+	return myText.c_str();
+}
+
+const char *
+ShaderSource::getError() const
+{
+	return myError;
+}
+
+bool
+ShaderSource::readFile(const char *path, std::string &text)
+{
+	FILE *file = nullptr;
+#ifdef _WIN32
+	if (fopen_s(&file, path, "rb") != 0)
+		file = nullptr;
+#else // macOS
+	file = fopen(path, "rb");
+#endif
+	if (!file)
+		return false;
+
+	char buffer[4096];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		text.append(buffer, read);
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	return ok;
+}
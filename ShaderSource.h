@@ -0,0 +1,55 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#ifndef ShaderSource_h
+#define ShaderSource_h
+
+#include "TOP_CPlusPlusBase.h"
+#include <string>
+
+class ShaderSource
+{
+	/*
+	 GLSL text for one shader stage, read from a DAT or a file and falling
+	 back to the built-in source when neither is set. update() only reads
+	 the text again once the DAT has cooked or the file has been modified,
+	 and returns true when the text changed. The first update() always
+	 does.
+	 */
+public:
+	ShaderSource(const char *builtIn);
+	ShaderSource(const ShaderSource&) = delete;
+	ShaderSource& operator=(const ShaderSource&) = delete;
+	bool update(const OP_DATInput *dat, const char *path);
+	const char *getText() const;
+	const char *getError() const;
+private:
+	static bool readFile(const char *path, std::string &text);
+	bool setText(std::string &text);
+
+	const char *myBuiltIn;
+	std::string myText;
+	bool myLoaded;
+	const char *myError;
+
+	// What the current text was read from
+	uint32_t myDATId;
+	int64_t myDATCooks;
+	std::string myPath;
+	int64_t myModified;
+	int64_t mySize;
+};
+
+#endif /* ShaderSource_h */
@@ -13,6 +13,7 @@
 */
 
 #include "Shape.h"
+#include "GLState.h"
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
 #else
@@ -20,32 +21,215 @@
 #define _USE_MATH_DEFINES
 #endif
 #include <cmath>
+#include <cstring>
 #include <math.h>
 #include "Matrix.h"
 
+// Persistent mapping needs glBufferStorage, from GL 4.4. The macOS core
+// profile stops at 4.1, so there dynamic shapes orphan instead.
+static bool
+supportsPersistentMapping()
+{
+#ifdef _WIN32
+	return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+#else
+	return false;
+#endif
+}
+
 Shape::Shape()
-: myVAO(0), myVBO(0), myElementCount(0), myTranslateX(0.0), myTranslateY(0.0),
-	myScaleX(1.0), myScaleY(1.0), myRotation(0.0)
+: myVAO(0), myVBO(0), myEBO(0), myIndexCount(0), myIndexType(GL_UNSIGNED_SHORT),
+	myCapacity(0), myIndexCapacity(0), myAttrib(-1), myDynamic(false),
+	myRing(false), myMapped(nullptr), mySlotSize(0), mySlot(0), myFences{}, myRingWaits(0),
+	myTranslateX(0.0), myTranslateY(0.0), myScaleX(1.0), myScaleY(1.0), myRotation(0.0)
 {
 }
 
 Shape::~Shape()
 {
+	for (int i = 0; i < RingSlots; i++)
+	{
+		if (myFences[i])
+			glDeleteSync(myFences[i]);
+	}
 	glDeleteVertexArrays(1, &myVAO);
-	glDeleteBuffers(1, &myVBO);
+
+	// Shared buffers belong to the source shape
+	if (!mySource)
+	{
+		// Deleting a mapped buffer unmaps it
+		glDeleteBuffers(1, &myVBO);
+		glDeleteBuffers(1, &myEBO);
+	}
 }
 
 void
-Shape::setVertices(GLfloat *vertices, int elements)
+Shape::share(const std::shared_ptr<const Shape> &source)
+{
+	// Buffers can be shared between contexts, VAOs can't, so this shape
+	// keeps its own VAO and transform and reads the source's buffers
+	mySource = source;
+	myVBO = source->myVBO;
+	myEBO = source->myEBO;
+	myIndexCount = source->myIndexCount;
+	myIndexType = source->myIndexType;
+}
+
+void
+Shape::setDynamic(bool dynamic)
+{
+	// Must be chosen before the first setVertices()
+	myDynamic = dynamic;
+}
+
+size_t
+Shape::VertexKeyHash::operator()(const VertexKey &key) const
+{
+	// FNV-1a over the position's bytes
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(key.p);
+	size_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeof(key.p); i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+void
+Shape::setVertices(const GLfloat *vertices, int elements)
+{
+	// Weld identical corners, every input vertex becomes an index. The
+	// staging arrays and the map keep their capacity between calls.
+	myStaging.clear();
+	myIndices.clear();
+	myWeld.clear();
+	for (int i = 0; i + 2 < elements; i += 3)
+	{
+		VertexKey key;
+		memcpy(key.p, vertices + i, sizeof(key.p));
+
+		auto found = myWeld.emplace(key, static_cast<uint32_t>(myStaging.size() / 3));
+		if (found.second)
+		{
+			myStaging.insert(myStaging.end(), vertices + i, vertices + i + 3);
+		}
+		myIndices.push_back(found.first->second);
+	}
+
+	GLsizei vertexCount = static_cast<GLsizei>(myStaging.size() / 3);
+	uploadVertices(myStaging.data(), vertexCount);
+	uploadIndices(vertexCount);
+}
+
+void
+Shape::uploadVertices(const GLfloat *vertices, GLsizei count)
 {
 	if (myVBO == 0)
 	{
 		glGenBuffers(1, &myVBO);
 	}
-	myElementCount = elements;
-	glBindBuffer(GL_ARRAY_BUFFER, myVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * elements, vertices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLsizeiptr size = 3 * sizeof(GLfloat) * count;
+	if (myDynamic && (myRing || (myCapacity == 0 && supportsPersistentMapping())))
+	{
+		if (writeRing(vertices, size))
+			return;
+	}
+	GLState::bindBuffer(GL_ARRAY_BUFFER, myVBO);
+	if (size > myCapacity)
+	{
+		// A shape that is only set once stays static, one that is set again
+		// is assumed to keep changing
+		glBufferData(GL_ARRAY_BUFFER, size, vertices, myCapacity == 0 ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+		myCapacity = size;
+	}
+	else
+	{
+		// Orphan the old storage so the upload doesn't wait on draws that
+		// are still reading it
+		glBufferData(GL_ARRAY_BUFFER, myCapacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices);
+	}
+}
+
+void
+Shape::setSOP(const OP_SOPInput *sop)
+{
+	const Position *positions = sop->getPointPositions();
+
+	// SOP points are already shared between primitives, so they become the
+	// vertices as they are and need no welding
+	GLsizei numPoints = sop->getNumPoints();
+	myStaging.resize(3 * static_cast<size_t>(numPoints));
+	for (GLsizei i = 0; i < numPoints; i++)
+	{
+		myStaging[3 * i + 0] = positions[i].x;
+		myStaging[3 * i + 1] = positions[i].y;
+		myStaging[3 * i + 2] = positions[i].z;
+	}
+
+	// Polygons are split into triangle fans, other primitives are skipped
+	myIndices.clear();
+	for (int32_t i = 0; i < sop->getNumPrimitives(); i++)
+	{
+		const SOP_PrimitiveInfo prim = sop->getPrimitive(i);
+		if (prim.type != PrimitiveType::Polygon || prim.numVertices < 3)
+			continue;
+
+		for (int32_t v = 1; v + 1 < prim.numVertices; v++)
+		{
+			myIndices.push_back(prim.pointIndices[0]);
+			myIndices.push_back(prim.pointIndices[v]);
+			myIndices.push_back(prim.pointIndices[v + 1]);
+		}
+	}
+
+	uploadVertices(myStaging.data(), numPoints);
+	uploadIndices(numPoints);
+}
+
+void
+Shape::uploadIndices(GLsizei vertexCount)
+{
+	// 16 bit indices halve the index bandwidth whenever they can address
+	// every vertex
+	const void *data;
+	GLsizeiptr size;
+	if (vertexCount <= 65536)
+	{
+		myShortIndices.assign(myIndices.begin(), myIndices.end());
+		myIndexType = GL_UNSIGNED_SHORT;
+		data = myShortIndices.data();
+		size = sizeof(GLushort) * myShortIndices.size();
+	}
+	else
+	{
+		myIndexType = GL_UNSIGNED_INT;
+		data = myIndices.data();
+		size = sizeof(uint32_t) * myIndices.size();
+	}
+	myIndexCount = static_cast<GLsizei>(myIndices.size());
+
+	// Uploaded through the copy target, so no VAO needs to be bound. The
+	// element buffer is attached to the VAO in pointAttrib().
+	bool created = myEBO == 0;
+	if (created)
+	{
+		glGenBuffers(1, &myEBO);
+	}
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, myEBO);
+	if (size > myIndexCapacity)
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, size, data, myIndexCapacity == 0 ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW);
+		myIndexCapacity = size;
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, myIndexCapacity, nullptr, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+	}
+
+	if (created && myVAO)
+		pointAttrib();
 }
 
 void
@@ -71,7 +255,7 @@ Shape::setScale(GLfloat x, GLfloat y)
 void
 Shape::bindVAO() const
 {
-	glBindVertexArray(myVAO);
+	GLState::bindVertexArray(myVAO);
 }
 
 void
@@ -85,35 +269,141 @@ Shape::setup(GLuint attrib)
 	{
 		glGenBuffers(1, &myVBO);
 	}
+	myAttrib = attrib;
+	pointAttrib();
+}
+
+void
+Shape::pointAttrib() const
+{
+	// A ring shape reads from the slot written last
+	size_t offset = myRing ? static_cast<size_t>(mySlot * mySlotSize) : 0;
+
 	bindVAO();
-	glBindBuffer(GL_ARRAY_BUFFER, myVBO);
-	glEnableVertexAttribArray(attrib);
-	glVertexAttribPointer(attrib, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-	glBindVertexArray(0);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, myEBO);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, myVBO);
+	glEnableVertexAttribArray(myAttrib);
+	glVertexAttribPointer(myAttrib, 3, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(offset));
+}
+
+bool
+Shape::writeRing(const GLfloat *vertices, GLsizeiptr size)
+{
+	if (size == 0)
+		return true;
+
+	if (size > mySlotSize)
+	{
+		if (!allocateRing(size))
+			return false;
+	}
+	else
+	{
+		// Every draw reading the current slot has been issued by now, so
+		// fence it and move on to the next slot
+		myFences[mySlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mySlot = (mySlot + 1) % RingSlots;
+	}
+
+	// The slot was fenced two writes ago, this only blocks if the GPU is
+	// more than two frames behind
+	if (myFences[mySlot])
+	{
+		GLenum status = glClientWaitSync(myFences[mySlot], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			myRingWaits++;
+			while (glClientWaitSync(myFences[mySlot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+				;
+		}
+		glDeleteSync(myFences[mySlot]);
+		myFences[mySlot] = 0;
+	}
+
+	// The mapping is coherent, so the write needs no flush
+	memcpy(static_cast<char*>(myMapped) + mySlot * mySlotSize, vertices, size);
+
+	if (myVAO)
+		pointAttrib();
+	return true;
+}
+
+bool
+Shape::allocateRing(GLsizeiptr size)
+{
+#ifdef _WIN32
+	// Storage is immutable, so growing means a new buffer. The old one is
+	// only freed once the GPU is done with it.
+	for (int i = 0; i < RingSlots; i++)
+	{
+		if (myFences[i])
+		{
+			glDeleteSync(myFences[i]);
+			myFences[i] = 0;
+		}
+	}
+	GLState::forgetBuffer(myVBO);
+	glDeleteBuffers(1, &myVBO);
+	glGenBuffers(1, &myVBO);
+
+	// Leave room to grow, streamed geometry rarely shrinks
+	mySlotSize = size + size / 2;
+	mySlot = 0;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLState::bindBuffer(GL_ARRAY_BUFFER, myVBO);
+	glBufferStorage(GL_ARRAY_BUFFER, RingSlots * mySlotSize, nullptr, flags);
+	myMapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, RingSlots * mySlotSize, flags);
+
+	if (myMapped)
+	{
+		myRing = true;
+		myCapacity = RingSlots * mySlotSize;
+		return true;
+	}
+
+	// Fall back to orphaning with a fresh, mutable buffer
+	GLState::forgetBuffer(myVBO);
+	glDeleteBuffers(1, &myVBO);
+	glGenBuffers(1, &myVBO);
+	mySlotSize = 0;
+	myRing = false;
+	myCapacity = 0;
+	if (myVAO)
+		pointAttrib();
+#endif
+	return false;
 }
 
 Matrix
 Shape::getMatrix() const
 {
-	Matrix scale;
-	scale[0] = myScaleX;
-	scale[5] = myScaleY;
+	// rotate * translate * scale, composed without the two multiplies
+	return Matrix::rotateTranslateScale(myRotation, myTranslateX, myTranslateY, myScaleX, myScaleY);
+}
 
-	Matrix translate;
-	translate[3] = myTranslateX;
-	translate[7] = myTranslateY;
+void
+Shape::getTransform(TransformBatch &batch, int index) const
+{
+	// The same transform as getMatrix(), left for the batch to evaluate
+	batch.set(index, myTranslateX, myTranslateY, myRotation, myScaleX, myScaleY);
+}
 
-	Matrix rotate;
-	rotate[0] = rotate[5] = std::cos(myRotation);
-	rotate[1] = std::sin(myRotation);
-	rotate[4] = -rotate[1];
-	rotate[10] = rotate[15] = 1.0;
+void
+Shape::drawInstanced(GLsizei instances) const
+{
+	// Expects the VAO to be bound
+	glDrawElementsInstanced(GL_TRIANGLES, myIndexCount, myIndexType, nullptr, instances);
+}
 
-	return rotate * translate * scale;
+GLsizei
+Shape::getIndexCount() const
+{
+	return myIndexCount;
 }
 
-GLint
-Shape::getElementCount() const
+int
+Shape::getRingWaits() const
 {
-	return myElementCount;
+	return myRingWaits;
 }
@@ -17,29 +17,85 @@
 
 #include "TOP_CPlusPlusBase.h"
 #include "Matrix.h"
+#include "TransformBatch.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 class Shape
 {
 	/*
-	 A very naive 2D shape
+	 A very naive 2D shape, drawn indexed. Corners shared by several
+	 triangles are welded into one vertex. A dynamic shape, one whose vertices change
+	 every frame, writes them into a persistently mapped ring of three
+	 slots when the driver supports it, so writing never waits on draws
+	 still reading an earlier slot.
 	 */
 public:
+	static const int RingSlots = 3;
+
 	Shape();
 	~Shape();
 	Shape(const Shape&) = delete;
 	Shape& operator=(const Shape&) = delete;
-	void setVertices(GLfloat *vertices, int elements);
+	void setVertices(const GLfloat *vertices, int elements);
+	void setSOP(const OP_SOPInput *sop);
+	void share(const std::shared_ptr<const Shape> &source);
 	void setRotation(GLfloat degrees);
 	void setTranslate(GLfloat x, GLfloat y);
 	void setScale(GLfloat x, GLfloat y);
+	void setDynamic(bool dynamic);
 	void setup(GLuint attrib);
 	void bindVAO() const;
+	void drawInstanced(GLsizei instances) const;
 	Matrix getMatrix() const;
-	GLint getElementCount() const;
+	void getTransform(TransformBatch &batch, int index) const;
+	GLsizei getIndexCount() const;
+	int getRingWaits() const;
 private:
+	// Welding compares positions bit for bit
+	struct VertexKey
+	{
+		GLfloat p[3];
+		bool operator==(const VertexKey &other) const
+		{
+			return memcmp(p, other.p, sizeof(p)) == 0;
+		}
+	};
+
+	struct VertexKeyHash
+	{
+		size_t operator()(const VertexKey &key) const;
+	};
+
+	void uploadVertices(const GLfloat *vertices, GLsizei count);
+	void uploadIndices(GLsizei vertexCount);
+	bool writeRing(const GLfloat *vertices, GLsizeiptr size);
+	bool allocateRing(GLsizeiptr size);
+	void pointAttrib() const;
+
 	GLuint myVAO;
 	GLuint myVBO;
-	GLuint myElementCount;
+	GLuint myEBO;
+	GLsizei myIndexCount;
+	GLenum myIndexType;
+	GLsizeiptr myCapacity;
+	GLsizeiptr myIndexCapacity;
+	std::vector<GLfloat> myStaging;
+	std::vector<uint32_t> myIndices;
+	std::vector<GLushort> myShortIndices;
+	std::unordered_map<VertexKey, uint32_t, VertexKeyHash> myWeld;
+	std::shared_ptr<const Shape> mySource;
+	GLint myAttrib;
+	bool myDynamic;
+	bool myRing;
+	void *myMapped;
+	GLsizeiptr mySlotSize;
+	int mySlot;
+	GLsync myFences[RingSlots];
+	int myRingWaits;
 	GLfloat myTranslateX;
 	GLfloat myTranslateY;
 	GLfloat myScaleX;
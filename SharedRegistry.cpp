@@ -0,0 +1,75 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "SharedRegistry.h"
+
+std::map<std::string, std::weak_ptr<Program>> SharedRegistry::ourPrograms;
+std::map<std::string, std::weak_ptr<const Shape>> SharedRegistry::ourShapes;
+
+template <typename T>
+std::shared_ptr<T>
+SharedRegistry::find(std::map<std::string, std::weak_ptr<T>> &entries, const std::string &key)
+{
+	// Drop entries whose last user has gone while we're here
+	for (auto it = entries.begin(); it != entries.end(); )
+	{
+		if (it->second.expired())
+			it = entries.erase(it);
+		else
+			++it;
+	}
+
+	auto found = entries.find(key);
+	if (found == entries.end())
+		return nullptr;
+	return found->second.lock();
+}
+
+std::shared_ptr<Program>
+SharedRegistry::getProgram(const char *vertex, const char *fragment)
+{
+	// The sources themselves are the key, so different programs can't collide
+	std::string key(vertex);
+	key.push_back('\0');
+	key.append(fragment);
+
+	std::shared_ptr<Program> program = find(ourPrograms, key);
+	if (program)
+		return program;
+
+	// Only submitted here, every node using it polls for the result. The
+	// same sources would fail the same way, so a failed program is kept too.
+	program = std::make_shared<Program>();
+	program->submit(vertex, fragment);
+
+	ourPrograms[key] = program;
+	return program;
+}
+
+std::shared_ptr<const Shape>
+SharedRegistry::getShape(const GLfloat *vertices, int elements)
+{
+	std::string key(reinterpret_cast<const char*>(vertices), sizeof(GLfloat) * elements);
+
+	std::shared_ptr<const Shape> shape = find(ourShapes, key);
+	if (shape)
+		return shape;
+
+	// Only the buffers are used by other nodes, so no VAO is set up here
+	std::shared_ptr<Shape> created = std::make_shared<Shape>();
+	created->setVertices(vertices, elements);
+
+	ourShapes[key] = created;
+	return created;
+}
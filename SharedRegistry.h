@@ -0,0 +1,46 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef SharedRegistry_h
+#define SharedRegistry_h
+
+#include "TOP_CPlusPlusBase.h"
+#include "Program.h"
+#include "Shape.h"
+#include <map>
+#include <memory>
+#include <string>
+
+class SharedRegistry
+{
+	/*
+	 Programs and static shape buffers shared by every node in the process,
+	 keyed by their shader source or vertex data. TouchDesigner's contexts
+	 are all in one share group, so the GL objects are valid in any of
+	 them. An entry is deleted when the last node using it lets go. Only
+	 called from cooks, which all happen on the main thread.
+	 */
+public:
+	static std::shared_ptr<Program> getProgram(const char *vertex, const char *fragment);
+	static std::shared_ptr<const Shape> getShape(const GLfloat *vertices, int elements);
+private:
+	template <typename T>
+	static std::shared_ptr<T> find(std::map<std::string, std::weak_ptr<T>> &entries,
+									const std::string &key);
+
+	static std::map<std::string, std::weak_ptr<Program>> ourPrograms;
+	static std::map<std::string, std::weak_ptr<const Shape>> ourShapes;
+};
+
+#endif /* SharedRegistry_h */
@@ -0,0 +1,159 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "TransformBatch.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+// sincos is evaluated by reducing the angle to within pi/4 of a multiple
+// of pi/2, then using the Cephes single precision polynomials. The
+// quadrant picks which polynomial gives sin and cos and their signs, so
+// there are no branches and four angles can go through at once.
+static const float TwoOverPi = 0.636619772367581f;
+static const float PiOverTwoHi = 1.5707963705062866f;
+static const float PiOverTwoLo = -4.371139000186243e-08f;
+static const float S1 = -1.6666654611e-1f;
+static const float S2 = 8.3321608736e-3f;
+static const float S3 = -1.9515295891e-4f;
+static const float C1 = 4.166664568298827e-2f;
+static const float C2 = -1.388731625493765e-3f;
+static const float C3 = 2.443315711809948e-5f;
+
+// Writes one model matrix, laid out as Matrix::rotateTranslateScale()
+static inline void
+writeMatrix(GLfloat *m, float c, float s, float x, float y, float sx, float sy)
+{
+	m[ 0] = c * sx;	m[ 1] = s * sx;	m[ 2] = 0.0f;	m[ 3] = x * sx;
+	m[ 4] = -s * sy;	m[ 5] = c * sy;	m[ 6] = 0.0f;	m[ 7] = y * sy;
+	m[ 8] = 0.0f;	m[ 9] = 0.0f;	m[10] = 1.0f;	m[11] = 0.0f;
+	m[12] = 0.0f;	m[13] = 0.0f;	m[14] = 0.0f;	m[15] = 1.0f;
+}
+
+static inline void
+sinCos(float angle, float *sinOut, float *cosOut)
+{
+	int j = static_cast<int>(std::floor(angle * TwoOverPi + 0.5f));
+	float fj = static_cast<float>(j);
+	float r = angle - fj * PiOverTwoHi - fj * PiOverTwoLo;
+	float r2 = r * r;
+
+	float s = r + r * r2 * (S1 + r2 * (S2 + r2 * S3));
+	float c = 1.0f - 0.5f * r2 + r2 * r2 * (C1 + r2 * (C2 + r2 * C3));
+
+	float sinValue = (j & 1) ? c : s;
+	float cosValue = (j & 1) ? s : c;
+	*sinOut = (j & 2) ? -sinValue : sinValue;
+	*cosOut = ((j + 1) & 2) ? -cosValue : cosValue;
+}
+
+TransformBatch::TransformBatch()
+: myCount(0)
+{
+}
+
+void
+TransformBatch::resize(int count)
+{
+	// The arrays keep their capacity when shrinking
+	myX.resize(count);
+	myY.resize(count);
+	myRotation.resize(count);
+	myScaleX.resize(count);
+	myScaleY.resize(count);
+	myCount = count;
+}
+
+int
+TransformBatch::size() const
+{
+	return myCount;
+}
+
+void
+TransformBatch::set(int index, GLfloat x, GLfloat y, GLfloat radians, GLfloat sx, GLfloat sy)
+{
+	myX[index] = x;
+	myY[index] = y;
+	myRotation[index] = radians;
+	myScaleX[index] = sx;
+	myScaleY[index] = sy;
+}
+
+void
+TransformBatch::evaluate(GLfloat *out, size_t stride) const
+{
+	// stride is in bytes, so matrices can be written straight into
+	// interleaved instance data
+	char *dest = reinterpret_cast<char*>(out);
+	int i = 0;
+
+#ifdef TRANSFORM_SSE
+	for (; i + 4 <= myCount; i += 4)
+	{
+		__m128 angle = _mm_loadu_ps(&myRotation[i]);
+
+		// Rounds to nearest, the default MXCSR mode
+		__m128i j = _mm_cvtps_epi32(_mm_mul_ps(angle, _mm_set1_ps(TwoOverPi)));
+		__m128 fj = _mm_cvtepi32_ps(j);
+		__m128 r = _mm_sub_ps(angle, _mm_mul_ps(fj, _mm_set1_ps(PiOverTwoHi)));
+		r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(PiOverTwoLo)));
+		__m128 r2 = _mm_mul_ps(r, r);
+
+		__m128 s = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(S3)), _mm_set1_ps(S2));
+		s = _mm_add_ps(_mm_mul_ps(r2, s), _mm_set1_ps(S1));
+		s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+
+		__m128 c = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(C3)), _mm_set1_ps(C2));
+		c = _mm_add_ps(_mm_mul_ps(r2, c), _mm_set1_ps(C1));
+		c = _mm_mul_ps(_mm_mul_ps(r2, r2), c);
+		c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), c);
+
+		// Odd quadrants swap sin and cos, the sign bits come from bit 1
+		const __m128i one = _mm_set1_epi32(1);
+		const __m128i two = _mm_set1_epi32(2);
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, one), one));
+		__m128 sinValue = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+		__m128 cosValue = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+		sinValue = _mm_xor_ps(sinValue, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, two), 30)));
+		cosValue = _mm_xor_ps(cosValue, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, one), two), 30)));
+
+		float sines[4];
+		float cosines[4];
+		_mm_storeu_ps(sines, sinValue);
+		_mm_storeu_ps(cosines, cosValue);
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int k = i + lane;
+			writeMatrix(reinterpret_cast<GLfloat*>(dest + k * stride), cosines[lane], sines[lane],
+						myX[k], myY[k], myScaleX[k], myScaleY[k]);
+		}
+	}
+#endif
+
+	// The tail, or everything without SSE. The loop has no branches the
+	// compiler can't turn into selects, so it can still be vectorised.
+	for (; i < myCount; i++)
+	{
+		float s;
+		float c;
+		sinCos(myRotation[i], &s, &c);
+		writeMatrix(reinterpret_cast<GLfloat*>(dest + i * stride), c, s,
+					myX[i], myY[i], myScaleX[i], myScaleY[i]);
+	}
+}
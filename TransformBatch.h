@@ -0,0 +1,46 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef TransformBatch_h
+#define TransformBatch_h
+
+#include "TOP_CPlusPlusBase.h"
+#include <vector>
+
+class TransformBatch
+{
+	/*
+	 Translate, rotation and scale for many instances of a shape, kept as
+	 one array per component. evaluate() turns all of them into model
+	 matrices in a single pass, four at a time where SIMD is available,
+	 giving the same matrices as Matrix::rotateTranslateScale().
+	 */
+public:
+	TransformBatch();
+	TransformBatch(const TransformBatch&) = delete;
+	TransformBatch& operator=(const TransformBatch&) = delete;
+	void resize(int count);
+	int size() const;
+	void set(int index, GLfloat x, GLfloat y, GLfloat radians, GLfloat sx, GLfloat sy);
+	void evaluate(GLfloat *out, size_t stride) const;
+private:
+	std::vector<GLfloat> myX;
+	std::vector<GLfloat> myY;
+	std::vector<GLfloat> myRotation;
+	std::vector<GLfloat> myScaleX;
+	std::vector<GLfloat> myScaleY;
+	int myCount;
+};
+
+#endif /* TransformBatch_h */
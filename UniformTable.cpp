@@ -0,0 +1,129 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#include "UniformTable.h"
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#endif
+
+#include <cstring>
+
+static const char *sourceNames[UniformTable::NumSources] = {
+	"uRotation",
+	"uResolution",
+	"uColor1",
+	"uColor2",
+	"uGeometryColor",
+	"uValue1",
+	"uValue2",
+	"uValue3",
+	"uValue4",
+	"uAlphaMode"
+};
+
+UniformTable::UniformTable()
+: myValues{}
+{
+}
+
+void
+UniformTable::reflect(GLuint program)
+{
+	myBindings.clear();
+	myUnbound.clear();
+
+	GLint count = 0;
+	GLint maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(program, i, static_cast<GLsizei>(name.size()), nullptr, &size, &type, name.data());
+
+		// Members of uniform blocks have no location, they're set through
+		// their buffer
+		GLint location = glGetUniformLocation(program, name.data());
+		if (location == -1)
+			continue;
+
+		// Arrays are reported as "name[0]", only their first element is set
+		char *bracket = strchr(name.data(), '[');
+		if (bracket)
+			*bracket = '\0';
+
+		int source = 0;
+		while (source < NumSources && strcmp(name.data(), sourceNames[source]) != 0)
+		{
+			source++;
+		}
+
+		bool supported = type == GL_FLOAT || type == GL_FLOAT_VEC2 ||
+						type == GL_FLOAT_VEC3 || type == GL_FLOAT_VEC4 || type == GL_INT;
+		if (source == NumSources || !supported)
+		{
+			if (!myUnbound.empty())
+				myUnbound.append(", ");
+			myUnbound.append(name.data());
+			continue;
+		}
+
+		myBindings.push_back({ location, type, static_cast<Source>(source) });
+	}
+}
+
+void
+UniformTable::set(Source source, double x, double y, double z, double w)
+{
+	myValues[source][0] = static_cast<GLfloat>(x);
+	myValues[source][1] = static_cast<GLfloat>(y);
+	myValues[source][2] = static_cast<GLfloat>(z);
+	myValues[source][3] = static_cast<GLfloat>(w);
+}
+
+void
+UniformTable::apply() const
+{
+	// The program must be current
+	for (const Binding &binding : myBindings)
+	{
+		const GLfloat *value = myValues[binding.source];
+		if (binding.type == GL_FLOAT)
+			glUniform1fv(binding.location, 1, value);
+		else if (binding.type == GL_FLOAT_VEC2)
+			glUniform2fv(binding.location, 1, value);
+		else if (binding.type == GL_FLOAT_VEC3)
+			glUniform3fv(binding.location, 1, value);
+		else if (binding.type == GL_INT)
+			glUniform1i(binding.location, static_cast<GLint>(value[0]));
+		else
+			glUniform4fv(binding.location, 1, value);
+	}
+}
+
+int
+UniformTable::getNumBound() const
+{
+	return static_cast<int>(myBindings.size());
+}
+
+const char *
+UniformTable::getUnbound() const
+{
+	return myUnbound.c_str();
+}
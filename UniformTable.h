@@ -0,0 +1,72 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+
+#ifndef UniformTable_h
+#define UniformTable_h
+
+#include "TOP_CPlusPlusBase.h"
+#include <string>
+#include <vector>
+
+class UniformTable
+{
+	/*
+	 The active uniforms of a program bound to values the node provides.
+	 reflect() walks the program's uniforms once after it links and keeps
+	 the location of each one it knows by name, so apply() only issues a
+	 glUniform call per entry without any lookups. Float, vec2, vec3 and
+	 vec4 uniforms take as many components of their value as they need,
+	 int uniforms take the first one.
+	 */
+public:
+	enum Source
+	{
+		Rotation,
+		Resolution,
+		Color1,
+		Color2,
+		GeometryColor,
+		Value1,
+		Value2,
+		Value3,
+		Value4,
+		AlphaMode,
+		NumSources
+	};
+
+	UniformTable();
+	UniformTable(const UniformTable&) = delete;
+	UniformTable& operator=(const UniformTable&) = delete;
+	void reflect(GLuint program);
+	void set(Source source, double x, double y = 0.0, double z = 0.0, double w = 1.0);
+	void apply() const;
+	int getNumBound() const;
+	const char *getUnbound() const;
+private:
+	struct Binding
+	{
+		GLint	location;
+		GLenum	type;
+		Source	source;
+	};
+
+	std::vector<Binding> myBindings;
+	GLfloat myValues[NumSources][4];
+
+	// Names of active uniforms nothing is bound to, comma separated
+	std::string myUnbound;
+};
+
+#endif /* UniformTable_h */
@@ -0,0 +1,298 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "VioCPUTOP.h"
+#include "VioError.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace VioApi;
+
+// The CPU receive variant is built by the configurations that define
+// VIOTOP_CPU_RECEIVE, a .dll can only export one kind of TOP.
+#ifdef VIOTOP_CPU_RECEIVE
+extern "C"
+{
+DLLEXPORT
+void
+FillTOPPluginInfo(TOP_PluginInfo *info)
+{
+	// This must always be set to this constant
+	info->apiVersion = TOPCPlusPlusAPIVersion;
+
+	// No OpenGL is used, the pixels are written straight into CPU memory
+	info->executeMode = TOP_ExecuteMode::CPUMemWriteOnly;
+
+	// The opType is the unique name for this TOP. It must start with a
+	// capital A-Z character, and all the following characters must lower case
+	// or numbers (a-z, 0-9)
+	info->customOPInfo.opType->setString("Viocpureceive");
+
+	// The opLabel is the text that will show up in the OP Create Dialog
+	info->customOPInfo.opLabel->setString("VIO CPU Receive");
+
+	// Will be turned into a 3 letter icon on the nodes
+	info->customOPInfo.opIcon->setString("VIO");
+
+	// Information about the author of this OP
+	info->customOPInfo.authorName->setString("Author Name");
+	info->customOPInfo.authorEmail->setString("email@email.com");
+
+	// This TOP works with 0 inputs
+	info->customOPInfo.minInputs = 0;
+	info->customOPInfo.maxInputs = 0;
+}
+
+DLLEXPORT
+TOP_CPlusPlusBase*
+CreateTOPInstance(const OP_NodeInfo* info, TOP_Context *context)
+{
+	return new VioCPUTOP(info, context);
+}
+
+DLLEXPORT
+void
+DestroyTOPInstance(TOP_CPlusPlusBase* instance, TOP_Context *context)
+{
+	// No OpenGL teardown is needed, so no GL context is requested
+	delete (VioCPUTOP*)instance;
+}
+
+};
+#endif
+
+
+VioCPUTOP::VioCPUTOP(const OP_NodeInfo* info, TOP_Context *context)
+: myNodeInfo(info), myExecuteCount(0), myVioHandle(0), myStreamInfo{},
+	myLocked(false), mySlot(0), myFrameCount(0), myDropCount(0), myCopyWidth(0), myCopyHeight(0),
+	myJobPending(false), myQuit(false), mySource(nullptr), mySourceStride(0),
+	myDest(nullptr), myDestStride(0), myRows(0), myRowBytes(0), myCopyMilliseconds(0.0)
+{
+	// A CPU stream doesn't need a graphics device
+	vInit(0, 0, 0);
+
+	memset(&myOpenPara, 0, sizeof(myOpenPara));
+	myOpenPara.Channel = 0;
+	myOpenPara.Mode = VM_FromVentuz;
+	myOpenPara.Transfer = VTM_Cpu;
+	myOpenPara.Color = VCP_BGRA_8;
+	myOpenPara.Depth = VDP_Off;
+	myOpenPara.SizeX = 256;
+	myOpenPara.SizeY = 256;
+
+	myWorker = std::thread(&VioCPUTOP::copyLoop, this);
+}
+
+VioCPUTOP::~VioCPUTOP()
+{
+	waitForCopy();
+
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		myQuit = true;
+	}
+	myCondition.notify_all();
+	myWorker.join();
+
+	if (myLocked)
+	{
+		vUnlockFrame(myVioHandle);
+	}
+	vClose(myVioHandle);
+	myVioHandle = 0;
+	vExit();
+}
+
+void
+VioCPUTOP::getGeneralInfo(TOP_GeneralInfo* ginfo, const OP_Inputs *inputs, void* reserved1)
+{
+	ginfo->cookEveryFrame = true;
+
+	// Matches VCP_BGRA_8, the preferred layout for 8-bit data
+	ginfo->memPixelType = OP_CPUMemPixelType::BGRA8Fixed;
+
+	// VIO buffers start with the top line, letting TouchDesigner flip on
+	// upload is cheaper than flipping while copying
+	ginfo->memFirstPixel = TOP_FirstPixel::TopLeft;
+}
+
+bool
+VioCPUTOP::getOutputFormat(TOP_OutputFormat* format, const OP_Inputs *inputs, void* reserved1)
+{
+	// Once the stream is open output at its size, so rows copy one to one
+	format->width = myStreamInfo.SizeX > 0 ? myStreamInfo.SizeX : myOpenPara.SizeX;
+	format->height = myStreamInfo.SizeY > 0 ? myStreamInfo.SizeY : myOpenPara.SizeY;
+	format->aspectX = static_cast<float>(format->width);
+	format->aspectY = static_cast<float>(format->height);
+	return true;
+}
+
+void
+VioCPUTOP::execute(TOP_OutputFormatSpecs* outputFormat,
+					const OP_Inputs* inputs,
+					TOP_Context* context,
+					void* reserved1)
+{
+	myExecuteCount++;
+
+	// Upload the frame copied since the last cook. Uploading invalidates that
+	// slot's memory, so the next copy goes into the following slot.
+	if (myLocked)
+	{
+		waitForCopy();
+
+		VERR(vUnlockFrame(myVioHandle));
+		myLocked = false;
+
+		// A copy made for another output size doesn't fit the slot now
+		if (outputFormat->width == myCopyWidth && outputFormat->height == myCopyHeight)
+		{
+			outputFormat->newCPUPixelDataLocation = mySlot;
+			mySlot = (mySlot + 1) % NumCPUPixelDatas;
+		}
+	}
+
+	if (!myVioHandle)
+	{
+		if (!VERR(vOpen(&myOpenPara, &myVioHandle)))
+			return;
+		VERR(vGetInfo(myVioHandle, &myStreamInfo));
+	}
+
+	// The output takes the stream's size from the next cook on. Until it
+	// has, a copy would be made for a slot of the wrong size.
+	if (myStreamInfo.SizeX > 0 && myStreamInfo.SizeY > 0 &&
+		(outputFormat->width != myStreamInfo.SizeX || outputFormat->height != myStreamInfo.SizeY))
+		return;
+
+	// Don't stall the cook waiting for Ventuz
+	if (vHasFrame(myVioHandle) != VE_Ok)
+		return;
+
+	vFrame frame;
+	vError error = vLockFrameEx2(myVioHandle, &frame, VLF_FillBuffers);
+	if (!VERR(error))
+	{
+		if (error == VE_ConnectionBroken)
+			myVioHandle = 0;
+		return;
+	}
+
+	myLocked = true;
+	myFrameCount = frame.FrameCount;
+	myDropCount = frame.DropCount;
+
+	// The pixel memory stays valid after execute() returns, and the VIO
+	// buffer stays valid while locked, so the copy runs on the worker and
+	// is picked up next cook.
+	int lines = frame.Lines > 0 ? frame.Lines : myStreamInfo.SizeY;
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		mySource = frame.ColorBuffer;
+		mySourceStride = frame.ColorStride;
+		myDest = static_cast<unsigned char*>(outputFormat->cpuPixelData[mySlot]);
+		myDestStride = outputFormat->width * 4;
+		myRows = std::min(lines, static_cast<int>(outputFormat->height));
+		myRowBytes = std::min(frame.ColorBytesPerLine, myDestStride);
+		myJobPending = true;
+	}
+	myCopyWidth = outputFormat->width;
+	myCopyHeight = outputFormat->height;
+	myCondition.notify_all();
+}
+
+int32_t
+VioCPUTOP::getNumInfoCHOPChans(void * reserved1)
+{
+	return 4;
+}
+
+void
+VioCPUTOP::getInfoCHOPChan(int32_t index, OP_InfoCHOPChan* chan, void * reserved1)
+{
+	if (index == 0)
+	{
+		chan->name->setString("executeCount");
+		chan->value = (float)myExecuteCount;
+	}
+
+	if (index == 1)
+	{
+		std::lock_guard<std::mutex> lock(myMutex);
+		chan->name->setString("copyMs");
+		chan->value = (float)myCopyMilliseconds;
+	}
+
+	if (index == 2)
+	{
+		chan->name->setString("frameCount");
+		chan->value = (float)myFrameCount;
+	}
+
+	if (index == 3)
+	{
+		chan->name->setString("dropCount");
+		chan->value = (float)myDropCount;
+	}
+}
+
+void
+VioCPUTOP::copyLoop()
+{
+	std::unique_lock<std::mutex> lock(myMutex);
+
+	while (true)
+	{
+		myCondition.wait(lock, [this] { return myJobPending || myQuit; });
+		if (myQuit)
+			break;
+
+		const unsigned char *source = mySource;
+		unsigned char *dest = myDest;
+		int sourceStride = mySourceStride;
+		int destStride = myDestStride;
+		int rows = myRows;
+		int rowBytes = myRowBytes;
+
+		lock.unlock();
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (sourceStride == destStride && rowBytes == destStride)
+		{
+			memcpy(dest, source, static_cast<size_t>(rows) * rowBytes);
+		}
+		else
+		{
+			for (int row = 0; row < rows; row++)
+			{
+				memcpy(dest + row * destStride, source + row * sourceStride, rowBytes);
+			}
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		lock.lock();
+		myCopyMilliseconds = milliseconds;
+		myJobPending = false;
+		myCondition.notify_all();
+	}
+}
+
+void
+VioCPUTOP::waitForCopy()
+{
+	std::unique_lock<std::mutex> lock(myMutex);
+	myCondition.wait(lock, [this] { return !myJobPending; });
+}
@@ -0,0 +1,82 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#include "TOP_CPlusPlusBase.h"
+#include "inc/VioApi.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class VioCPUTOP : public TOP_CPlusPlusBase
+{
+	/*
+	 Receives a VTM_Cpu stream from Ventuz without using OpenGL. Frames are
+	 copied from the VIO buffer into TouchDesigner's CPU pixel memory on a
+	 worker thread and uploaded on the following cook.
+	 */
+public:
+	VioCPUTOP(const OP_NodeInfo *info, TOP_Context *context);
+	virtual ~VioCPUTOP();
+
+	virtual void		getGeneralInfo(TOP_GeneralInfo*, const OP_Inputs*, void* reserved1) override;
+	virtual bool		getOutputFormat(TOP_OutputFormat*, const OP_Inputs*, void* reserved1) override;
+
+
+	virtual void		execute(TOP_OutputFormatSpecs*,
+								const OP_Inputs*,
+								TOP_Context *context, void* reserved1) override;
+
+
+	virtual int32_t		getNumInfoCHOPChans(void* reserved1) override;
+	virtual void		getInfoCHOPChan(int32_t index,
+										OP_InfoCHOPChan *chan,
+										void* reserved1) override;
+
+private:
+	void				copyLoop();
+	void				waitForCopy();
+
+	const OP_NodeInfo*	myNodeInfo;
+
+	int32_t				myExecuteCount;
+
+	VioApi::vHandle		myVioHandle;
+	VioApi::vOpenPara	myOpenPara;
+	VioApi::vInfo		myStreamInfo;
+
+	// The frame being copied stays locked until its copy is uploaded
+	bool				myLocked;
+	int					mySlot;
+	int64_t				myFrameCount;
+	int64_t				myDropCount;
+
+	// The output size the locked frame was copied for
+	int					myCopyWidth;
+	int					myCopyHeight;
+
+	// The copy job handed to the worker
+	std::thread			myWorker;
+	std::mutex			myMutex;
+	std::condition_variable	myCondition;
+	bool				myJobPending;
+	bool				myQuit;
+	const unsigned char*	mySource;
+	int					mySourceStride;
+	unsigned char*		myDest;
+	int					myDestStride;
+	int					myRows;
+	int					myRowBytes;
+	double				myCopyMilliseconds;
+};
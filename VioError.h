@@ -0,0 +1,31 @@
+/* Shared Use License: This file is owned by Derivative Inc. (Derivative)
+* and can only be used, and/or modified for use, in conjunction with
+* Derivative's TouchDesigner software, and only if you are a licensee who has
+* accepted Derivative's TouchDesigner license or assignment agreement
+* (which also govern the use of this file). You may share or redistribute
+* a modified version of this file provided the following conditions are met:
+*
+* 1. The shared file or redistribution must retain the information set out
+* above and this list of conditions.
+* 2. Derivative's name (Derivative Inc.) or its trademarks may not be used
+* to endorse or promote products derived from this file without specific
+* prior written permission from Derivative.
+*/
+
+#ifndef VioError_h
+#define VioError_h
+
+#include "inc/VioApi.h"
+
+// Setup error handling for Ventuz VIO functions
+#define VERR(x) vErr((x),__FILE__,__LINE__)
+
+inline bool vErr(VioApi::vError err, const char* file, int line)
+{
+	if (err == VioApi::VE_Ok)
+		return true;
+	//DPrintF("%s(%d): %s\n", file, line, vGetErrorString(err));
+	return false;
+}
+
+#endif /* VioError_h */
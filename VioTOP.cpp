@@ -13,6 +13,9 @@
 */
 
 #include "VioTOP.h"
+#include "VioError.h"
+#include "ProgramCache.h"
+#include "GLState.h"
 
 #include <assert.h>
 #ifdef __APPLE__
@@ -20,6 +23,8 @@
 #include <string.h>
 #endif
 #include <cstdio>
+#include <cstdlib>
+#include <chrono>
 
 using namespace VioApi;
 
@@ -30,36 +35,239 @@ using namespace VioApi;
 #endif
 
 static const char *vertexShader = "#version 330\n\
-uniform mat4 uModelView; \
-in vec3 P; \
+layout(std140) uniform Frame { \
+	mat4 uView; \
+}; \
+layout(location = 0) in vec3 P; \
+layout(location = 1) in mat4 iModel; \
+layout(location = 5) in vec4 iColor; \
+out vec4 vColor; \
 void main() { \
-	gl_Position = vec4(P, 1) * uModelView; \
+	gl_Position = vec4(P, 1) * iModel * uView; \
+	vColor = iColor; \
 }";
 
-static const char *fragmentShader = "#version 330\n\
-uniform vec4 uColor; \
+// The Alpha menu's conversion, done where the color is written so it
+// never needs a pass of its own. uAlphaMode follows the menu's order.
+#define ALPHA_CONVERSION "\
+uniform int uAlphaMode; \
+vec4 convertAlpha(vec4 c) { \
+	if (uAlphaMode == 1) return vec4(c.rgb * c.a, c.a); \
+	if (uAlphaMode == 2) return c.a > 0.0 ? vec4(c.rgb / c.a, c.a) : vec4(0.0); \
+	if (uAlphaMode == 3) return vec4(c.rgb, 1.0 - c.a); \
+	if (uAlphaMode == 4) return vec4(vec3(c.a), 1.0); \
+	return c; \
+} "
+
+// The key always carries the drawn coverage, whatever the alpha mode
+// does to the fill's alpha
+static const char *fragmentShader = "#version 330\n"
+ALPHA_CONVERSION "\
+in vec4 vColor; \
+layout(location = 0) out vec4 finalColor; \
+layout(location = 1) out vec4 keyColor; \
+void main() { \
+	finalColor = convertAlpha(vColor); \
+	keyColor = vec4(vec3(vColor.a), 1.0); \
+}";
+
+// Copies a received VIO texture into the output when its alpha needs
+// converting, one triangle covering the whole output
+static const char *copyVertexShader = "#version 330\n\
+out vec2 vUV; \
+void main() { \
+	vUV = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2); \
+	gl_Position = vec4(vUV * 2.0 - 1.0, 0.0, 1.0); \
+}";
+
+static const char *copyFragmentShader = "#version 330\n"
+ALPHA_CONVERSION "\
+uniform sampler2D uSource; \
+in vec2 vUV; \
 out vec4 finalColor; \
 void main() { \
-	finalColor = uColor; \
+	finalColor = convertAlpha(texture(uSource, vUV)); \
 }";
 
-static const char *uniformError = "A uniform location could not be found.";
+// The uniform buffer binding the Frame block is read from
+static const GLuint FrameBinding = 0;
+
+// Attribute locations are fixed in the shader, so shapes can be set up
+// before the program has finished building. iModel takes 1 to 4.
+static const GLuint PositionAttrib = 0;
+static const GLuint ModelAttrib = 1;
+static const GLuint ColorAttrib = 5;
+
+// Matches the std140 layout of the Frame block
+struct FrameConstants
+{
+	GLfloat		view[16];
+};
+
+static const char *shaderWarning = "The shaders could not be built, the last working ones are still used.";
+static const char *ancOverflowWarning = "Too much anc data for one frame, some blobs were dropped.";
+static const char *keyWarning = "The key stream on the next channel could not be opened, only the fill is sent.";
+
+// Cooks to wait before trying again to open a key stream that failed
+static const int32_t KeyReopenCooks = 60;
+
+// Flattens a TouchDesigner 4x4 transform into the float layout sent as anc,
+// keeping the same element order TouchDesigner returns it in.
+static void
+toAncMatrix(const double in[4][4], float out[16])
+{
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			out[row * 4 + col] = static_cast<float>(in[row][col]);
+		}
+	}
+}
+
+// Packs a CHOP into anc blobs. Channels are grouped by the first four
+// characters of their name, which form the FOURCC, and every sample of every
+// channel in a group is sent in channel order. e.g. TALYa and TALYb become
+// one TALY blob.
+static void
+packAncCHOP(const OP_CHOPInput *chop, AncWriter &writer)
+{
+	vuint fourccs[AncWriter::MaxBlobs];
+	int counts[AncWriter::MaxBlobs];
+	int numGroups = 0;
+	int numDropped = 0;
+
+	for (int i = 0; i < chop->numChannels; i++)
+	{
+		const char *name = chop->getChannelName(i);
+		if (strlen(name) < 4)
+			continue;
+
+		vuint fourcc = vFOURCC(name[0], name[1], name[2], name[3]);
+		int group = 0;
+		while (group < numGroups && fourccs[group] != fourcc)
+			group++;
+
+		if (group == numGroups)
+		{
+			if (numGroups == AncWriter::MaxBlobs)
+			{
+				// Each group that doesn't fit is dropped once, at its
+				// first channel
+				bool seen = false;
+				for (int j = 0; j < i && !seen; j++)
+				{
+					const char *other = chop->getChannelName(j);
+					seen = strlen(other) >= 4 && strncmp(other, name, 4) == 0;
+				}
+				if (!seen)
+					numDropped++;
+				continue;
+			}
+			fourccs[numGroups] = fourcc;
+			counts[numGroups] = 0;
+			numGroups++;
+		}
+		counts[group] += chop->numSamples;
+	}
+
+	writer.addDropped(numDropped);
+
+	for (int group = 0; group < numGroups; group++)
+	{
+		float *data = writer.addBlob(fourccs[group], counts[group]);
+		if (!data)
+			continue;
+
+		for (int i = 0; i < chop->numChannels; i++)
+		{
+			const char *name = chop->getChannelName(i);
+			if (strlen(name) >= 4 && static_cast<vuint>(vFOURCC(name[0], name[1], name[2], name[3])) == fourccs[group])
+			{
+				memcpy(data, chop->getChannelData(i), chop->numSamples * sizeof(float));
+				data += chop->numSamples;
+			}
+		}
+	}
+}
+
+// Packs a DAT into anc blobs, one per row. The first cell is the FOURCC and
+// the remaining cells are sent as floats.
+static void
+packAncDAT(const OP_DATInput *dat, AncWriter &writer)
+{
+	for (int row = 0; row < dat->numRows; row++)
+	{
+		if (dat->numCols < 2)
+			break;
+
+		const char *code = dat->getCell(row, 0);
+		if (strlen(code) != 4)
+			continue;
+
+		float *data = writer.addBlob(vFOURCC(code[0], code[1], code[2], code[3]), dat->numCols - 1);
+		if (!data)
+			continue;
+
+		for (int col = 1; col < dat->numCols; col++)
+		{
+			data[col - 1] = static_cast<float>(atof(dat->getCell(row, col)));
+		}
+	}
+}
+
+// Copies one color attachment into another framebuffer's attachment. Both
+// must be the same size and, if multisampled, have the same sample count.
+// The draw framebuffer is left bound and drawing only to that attachment.
+static void
+blitAttachment(GLuint from, GLenum fromAttachment, GLuint to, GLenum toAttachment, int width, int height)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+	glReadBuffer(fromAttachment);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+	glDrawBuffer(toAttachment);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+						GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+}
 
-// Setup error handling for Ventuz VIO functions
-#define VERR(x) vErr((x),__FILE__,__LINE__)
+// The samples per pixel the Antialias menu asks for
+static int
+antialiasSamples(const OP_Inputs *inputs)
+{
+	const int samples[] = { 1, 2, 4, 8 };
+	int index = inputs->getParInt("Antialias");
+	return index >= 0 && index < 4 ? samples[index] : 1;
+}
 
-bool vErr(vError err, const char* file, int line)
+// Builds an OpenGL style perspective projection, matching what a
+// TouchDesigner Camera COMP produces for the same field of view.
+static void
+perspective(double fovDegrees, double aspect, double nearPlane, double farPlane, double out[4][4])
 {
-	if (err == VE_Ok)
-		return true;
-	//DPrintF("%s(%d): %s\n", file, line, vGetErrorString(err));
-	return false;
+	double f = 1.0 / std::tan(fovDegrees * 3.14159265358979323846 / 360.0);
+
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			out[row][col] = 0.0;
+		}
+	}
+
+	out[0][0] = f / aspect;
+	out[1][1] = f;
+	out[2][2] = (farPlane + nearPlane) / (nearPlane - farPlane);
+	out[2][3] = (2.0 * farPlane * nearPlane) / (nearPlane - farPlane);
+	out[3][2] = -1.0;
 }
 
 // These functions are basic C function, which the DLL loader can find
 // much easier than finding a C++ Class.
 // The DLLEXPORT prefix is needed so the compile exports these functions from the .dll
 // you are creating
+// The CPU receive configurations build VioCPUTOP instead, see VioCPUTOP.cpp
+#ifndef VIOTOP_CPU_RECEIVE
 extern "C"
 {
 DLLEXPORT
@@ -123,12 +331,17 @@ DestroyTOPInstance(TOP_CPlusPlusBase* instance, TOP_Context *context)
 }
 
 };
+#endif
 
 
 VioTOP::VioTOP(const OP_NodeInfo* info, TOP_Context *context)
 : myNodeInfo(info), myExecuteCount(0), myRotation(0.0), myError(nullptr),
-	myProgram(), myDidSetup(false), myModelViewUniform(-1), myColorUniform(-1),
-	VioHandle(0)
+	myVertexSource(vertexShader), myFragmentSource(fragmentShader), myShaderChanged(false),
+	myProgram(), myPendingProgram(),
+	myGeometryId(0), myGeometryCooks(0), myDidSetup(false), myFrameUBO(0),
+	myCopyProgram(), myCopyReady(false), myCopyVAO(0), myCopySampler(0),
+	myVioMilliseconds(0.0), myVioFBO(0), myCachedScene{}, myLastScene{}, myCacheValid(false), myIdleCount(0),
+	VioHandle(0), myKeyHandle(0), myKeyMissing(false), myKeyRetryCooks(0), myStreamInfo{}
 {
 
 #ifdef _WIN32
@@ -170,6 +383,25 @@ VioTOP::VioTOP(const OP_NodeInfo* info, TOP_Context *context)
 
 VioTOP::~VioTOP()
 {
+	if (myVioFBO)
+	{
+		glDeleteFramebuffers(1, &myVioFBO);
+	}
+	if (myFrameUBO)
+	{
+		glDeleteBuffers(1, &myFrameUBO);
+	}
+	if (myCopyVAO)
+	{
+		glDeleteVertexArrays(1, &myCopyVAO);
+		glDeleteSamplers(1, &myCopySampler);
+	}
+
+	if (myKeyHandle)
+	{
+		vClose(myKeyHandle);
+		myKeyHandle = 0;
+	}
 	vClose(VioHandle);
 	VioHandle = 0;
 	vExit();
@@ -181,6 +413,9 @@ VioTOP::getGeneralInfo(TOP_GeneralInfo* ginfo, const OP_Inputs *inputs, void* re
 	// Setting cookEveryFrame to true causes the TOP to cook every frame even
 	// if none of its inputs/parameters are changing. Set it to false if it
 	// only needs to cook when inputs/parameters change.
+	// Sending and receiving both stream every frame, even an unchanged one,
+	// and a stream that isn't open yet or broke is retried by cooking. So
+	// we cook whether or not anything uses our output.
 	ginfo->cookEveryFrame = true;
 }
 
@@ -196,6 +431,17 @@ VioTOP::getOutputFormat(TOP_OutputFormat* format, const OP_Inputs *inputs, void*
 	format->height = 256;
 	format->aspectX = 1;
 	format->aspectY = 1;
+
+	// Progressive sends draw straight into a multisampled output, which is
+	// resolved into the VIO texture. Interlaced output antialiases its own
+	// field target instead, and received frames are already resolved.
+	// Fill and key are drawn to two color buffers at once
+	if (inputs->getParInt("Mode") == 0 && inputs->getParInt("Interlace") == 0)
+	{
+		format->antiAlias = antialiasSamples(inputs);
+		if (inputs->getParInt("Fillkey"))
+			format->numColorBuffers = 2;
+	}
 	return true;
 }
 
@@ -208,113 +454,491 @@ VioTOP::execute(TOP_OutputFormatSpecs* outputFormat ,
 {
 	myError = nullptr;
 	myExecuteCount++;
+	myVioMilliseconds = 0.0;
 
 	// These functions must be called before
 	// beginGLCommands()/endGLCommands() block
 	double speed = inputs->getParDouble("Speed");
 
-	double color1[3];
-	double color2[3];
-
-	inputs->getParDouble3("Color1", color1[0], color1[1], color1[2]);
-	inputs->getParDouble3("Color2", color2[0], color2[1], color2[2]);
-
 	myRotation += speed;
 
 	int width = outputFormat->width;
 	int height = outputFormat->height;
 
+	// Snapshot everything the scene depends on. If it matches what the
+	// cached frame was drawn with, the scene doesn't need drawing again.
+	SceneParameters scene;
+	scene.rotation = myRotation;
+	scene.width = width;
+	scene.height = height;
+	scene.samples = outputFormat->antiAlias;
+	scene.colorBuffers = outputFormat->numColorBuffers;
+	scene.alphaMode = inputs->getParInt("Alphamode");
+	inputs->getParDouble3("Color1", scene.color1[0], scene.color1[1], scene.color1[2]);
+	inputs->getParDouble3("Color2", scene.color2[0], scene.color2[1], scene.color2[2]);
+	inputs->getParDouble3("Geometrycolor", scene.geometryColor[0], scene.geometryColor[1], scene.geometryColor[2]);
+
+	const OP_SOPInput *geometrySOP = inputs->getParSOP("Geometrysop");
+	scene.geometryId = geometrySOP ? geometrySOP->opId : 0;
+	scene.geometryCooks = geometrySOP ? geometrySOP->totalCooks : 0;
+
+	const char *valueNames[] = { "Value1", "Value2", "Value3", "Value4" };
+	for (int i = 0; i < 4; i++)
+	{
+		inputs->getParDouble4(valueNames[i], scene.values[i][0], scene.values[i][1],
+								scene.values[i][2], scene.values[i][3]);
+	}
+
+	// Kept until the new sources have been submitted, a cook can return
+	// before getting that far
+	if (myVertexSource.update(inputs->getParDAT("Vertexdat"), inputs->getParFilePath("Vertexfile")))
+		myShaderChanged = true;
+	if (myFragmentSource.update(inputs->getParDAT("Fragmentdat"), inputs->getParFilePath("Fragmentfile")))
+		myShaderChanged = true;
+
+	bool redrawOnChange = inputs->getParInt("Redrawonchange") != 0;
+	bool sceneDirty = !redrawOnChange || !myCacheValid || !(scene == myCachedScene);
+
+	// Only a scene that held still since the last cook is worth caching,
+	// one that changes every cook would pay for the copy and never use it
+	bool sceneSteady = scene == myLastScene;
+	myLastScene = scene;
+
 	float ratio = static_cast<float>(height) / static_cast<float>(width);
 
+	vMode mode = inputs->getParInt("Mode") == 1 ? VM_FromVentuz : VM_ToVentuz;
+
+	if (mode == VM_FromVentuz)
+	{
+		myAncTable.setCustomFourCCs(inputs->getParString("Ancfourccs"));
+	}
+
+	// Anc is sampled here, in the same cook as the frame it describes, and
+	// sent on that frame's lock.
+	myAncWriter.reset();
+	if (mode == VM_ToVentuz && inputs->getParInt("Sendcamera") && inputs->getParObject("Camera"))
+	{
+		double camera[4][4];
+		bool valid;
+
+		if (inputs->getParObject("Origin"))
+		{
+			valid = inputs->getRelativeTransform("Camera", "Origin", camera);
+		}
+		else
+		{
+			memcpy(camera, inputs->getParObject("Camera")->worldTransform, sizeof(camera));
+			valid = true;
+		}
+
+		if (valid)
+		{
+			double projection[4][4];
+			perspective(inputs->getParDouble("Fov"),
+						static_cast<double>(width) / static_cast<double>(height),
+						inputs->getParDouble("Near"), inputs->getParDouble("Far"),
+						projection);
+
+			float *data = myAncWriter.addBlob(vANC_CameraMatrix, 16);
+			if (data)
+				toAncMatrix(camera, data);
+
+			data = myAncWriter.addBlob(vANC_ProjectionMatrix, 16);
+			if (data)
+				toAncMatrix(projection, data);
+		}
+	}
+
+	if (mode == VM_ToVentuz)
+	{
+		const OP_CHOPInput *ancCHOP = inputs->getParCHOP("Ancchop");
+		if (ancCHOP)
+			packAncCHOP(ancCHOP, myAncWriter);
+
+		const OP_DATInput *ancDAT = inputs->getParDAT("Ancdat");
+		if (ancDAT)
+			packAncDAT(ancDAT, myAncWriter);
+	}
+
+	// Interlaced output is only available for CPU transfers
+	int interlace = mode == VM_ToVentuz ? inputs->getParInt("Interlace") : 0;
+	vTransferMode transfer = interlace ? VTM_Cpu : VTM_OpenGl;
+	vStreamFlags flags = interlace ? VSF_Interlaced : VSF_None;
+
+	bool deferredFill = inputs->getParInt("Deferredfill") != 0;
+
+	// Pacing follows the stream opened so far, a new one starts it over
+	bool genlock = mode == VM_ToVentuz && !interlace && inputs->getParInt("Genlock") != 0;
+	int sends = 1;
+	if (genlock)
+		sends = myPacer.beginCook(myStreamInfo);
+	else
+		myPacer.reset();
+
+	// What the output actually got, which may be fewer than asked for
+	int samples = interlace ? antialiasSamples(inputs) : outputFormat->antiAlias;
+	if (samples < 1)
+		samples = 1;
+
+	// The key is sent as its own stream on the next channel
+	bool fillKey = mode == VM_ToVentuz && !interlace && inputs->getParInt("Fillkey") &&
+					outputFormat->numColorBuffers >= 2;
+
 	Matrix view;
 	view[0] = ratio;
 
-	//context->getShareRenderContext();
+	context->beginGLCommands();
 
-	//context->beginGLCommands();
+	// Nothing is known about the state TouchDesigner hands us
+	GLState::invalidate();
+
+	// Switching direction or transfer needs a new stream
+	if (mode != OpenPara.Mode || transfer != OpenPara.Transfer || flags != OpenPara.Flags)
+	{
+		if (VioHandle)
+		{
+			vClose(VioHandle);
+			VioHandle = 0;
+		}
+		if (myKeyHandle)
+		{
+			vClose(myKeyHandle);
+			myKeyHandle = 0;
+		}
+		myKeyRetryCooks = 0;
+		OpenPara.Mode = mode;
+		OpenPara.Transfer = transfer;
+		OpenPara.Flags = flags;
+	}
 
 	if (!VioHandle)
 	{
 		if (!VERR(vOpen(&OpenPara, &VioHandle)))
+		{
+			GLState::restore();
+			context->endGLCommands();
 			return;
+		}
+		VERR(vGetInfo(VioHandle, &myStreamInfo));
+		myPacer.reset();
 	}
 
-	vFrame frame;
-	vError error = vLockFrame(VioHandle, &frame);
-	if (!VERR(error))
+	if (fillKey && !myKeyHandle)
 	{
-		if (error == VE_ConnectionBroken)
-			VioHandle = 0;
-		return;
+		if (myKeyRetryCooks > 0)
+		{
+			myKeyRetryCooks--;
+		}
+		else
+		{
+			vOpenPara keyPara = OpenPara;
+			keyPara.Channel = OpenPara.Channel + 1;
+			if (!VERR(vOpen(&keyPara, &myKeyHandle)))
+			{
+				myKeyHandle = 0;
+				myKeyRetryCooks = KeyReopenCooks;
+			}
+			else
+			{
+				// The cached key may be missing or from an older scene
+				myCacheValid = false;
+			}
+		}
+	}
+	else if (!fillKey)
+	{
+		if (myKeyHandle)
+		{
+			vClose(myKeyHandle);
+			myKeyHandle = 0;
+		}
+		myKeyRetryCooks = 0;
 	}
-	
+
+	myKeyMissing = fillKey && !myKeyHandle;
+
+	// Without the key stream only the fill is sent
+	if (!myKeyHandle)
+		fillKey = false;
+
 	setupGL();
 
-	if (!myError)
+	if (myShaderChanged)
+		submitProgram();
+
+	// Until a program is ready the last frame is shown, or nothing
+	bool programReady = pollProgram();
+
+	// Without any program to draw with a failed build is an error,
+	// otherwise the last working one is still drawing
+	if (!programReady && !myShaderError.empty())
+		myError = myShaderError.c_str();
+
+	if (myError)
 	{
-		
+		GLState::restore();
+		context->endGLCommands();
+		return;
+	}
 
-		
-		
-		glViewport(0, 0, width, height);
-		glClearColor(0.0, 0.0, 0.0, 0.0);
-		glClear(GL_COLOR_BUFFER_BIT);
+	// A program that just replaced the old one has invalidated the cache
+	if (!myCacheValid)
+		sceneDirty = true;
+	else if (!programReady)
+		sceneDirty = false;
+
+	// Only upload the SOP's geometry when it has cooked since the last upload
+	if (scene.geometryId != myGeometryId || scene.geometryCooks != myGeometryCooks)
+	{
+		if (geometrySOP)
+			myGeometry.setSOP(geometrySOP);
+		else
+			myGeometry.setVertices(nullptr, 0);
+
+		myGeometryId = scene.geometryId;
+		myGeometryCooks = scene.geometryCooks;
+	}
+
+	vFrame frame;
+
+	if (OpenPara.Mode == VM_FromVentuz)
+	{
+		if (lockFrame(VioHandle, &frame, VLF_FillBuffers))
+		{
+			myAncTable.drain(VioHandle);
 
-		glUseProgram(myProgram.getName());
+			// Copy the Ventuz texture into our output, scaling it if the
+			// incoming stream differs from the TOP's resolution
 
-		// Draw the square
+			myTimer.begin(GpuTimer::VioCopy);
+
+			if (scene.alphaMode != 0 && pollCopyProgram())
+			{
+				// Drawn instead of blitted, so the alpha is converted in
+				// the same pass
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->getFBOIndex());
+				GLState::viewport(0, 0, width, height);
+				GLState::useProgram(myCopyProgram->getName());
+				myCopyUniforms.set(UniformTable::AlphaMode, scene.alphaMode);
+				myCopyUniforms.apply();
+
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, frame.GlColorName);
+				glBindSampler(0, myCopySampler);
+				GLState::bindVertexArray(myCopyVAO);
+				glDrawArrays(GL_TRIANGLES, 0, 3);
+				glBindSampler(0, 0);
+				glBindTexture(GL_TEXTURE_2D, 0);
+			}
+			else
+			{
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, myVioFBO);
+				glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frame.GlColorName, 0);
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->getFBOIndex());
+				glBlitFramebuffer(0, 0, myStreamInfo.SizeX, myStreamInfo.SizeY, 0, 0, width, height,
+									GL_COLOR_BUFFER_BIT, GL_LINEAR);
+				glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			}
 
-		glUniform4f(myColorUniform, static_cast<GLfloat>(color1[0]), static_cast<GLfloat>(color1[1]), static_cast<GLfloat>(color1[2]), 1.0f);
+			myTimer.end();
 
-		mySquare.setTranslate(0.5f, 0.5f);
-		mySquare.setRotation(static_cast<GLfloat>(myRotation));
+			unlockFrame(VioHandle);
+		}
+	}
+	else if (interlace)
+	{
+		// Each field is rendered at its own point in time, half a frame
+		// apart, straight into a half height target and read back into the
+		// field's lines of the VIO buffer.
+		int fieldHeight = height / 2;
+		myFieldTarget.setup(width, fieldHeight, samples);
+
+		// A multisampled field is resolved before it can be read back
+		GLuint fieldRead = myFieldTarget.getFBO();
+		if (samples > 1)
+		{
+			myFieldResolve.setup(width, fieldHeight);
+			fieldRead = myFieldResolve.getFBO();
+		}
 
-		Matrix model = mySquare.getMatrix();
-		glUniformMatrix4fv(myModelViewUniform, 1, GL_FALSE, (model * view).matrix);
+		for (int field = 0; field < 2; field++)
+		{
+			vLockFlags fieldFlags;
+			if (interlace == 1)
+				fieldFlags = field ? VLF_InterlaceField1 : VLF_InterlaceField0;
+			else
+				fieldFlags = field ? VLF_InterlaceInterleaved1 : VLF_InterlaceInterleaved0;
 
-		mySquare.bindVAO();
+			if (!lockFrame(VioHandle, &frame, static_cast<vLockFlags>(VLF_FillBuffers | fieldFlags)))
+				break;
 
-		glDrawArrays(GL_TRIANGLES, 0, mySquare.getElementCount() / 3);
+			if (field == 0)
+				VERR(myAncWriter.submit(VioHandle));
 
-		// Draw the chevron
+			// Picks the field's lines out of the progressive picture and flips
+			// it, so the rows read back come out top line first like VIO
+			// expects. Field 0 holds the top line.
+			Matrix fieldView = view;
+			fieldView[5] = -1.0f;
+			fieldView[7] = static_cast<GLfloat>(1 - 2 * field) / static_cast<GLfloat>(height);
 
-		glUniform4f(myColorUniform, static_cast<GLfloat>(color2[0]), static_cast<GLfloat>(color2[1]), static_cast<GLfloat>(color2[2]), 1.0f);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, myFieldTarget.getFBO());
+			GLState::viewport(0, 0, width, fieldHeight);
+			drawScene(fieldView, myRotation + speed * 0.5 * (field - 1), scene);
 
-		myChevron.setScale(0.8f, 0.8f);
-		myChevron.setTranslate(-0.5, -0.5);
-		myChevron.setRotation(static_cast<GLfloat>(myRotation));
+			myTimer.begin(GpuTimer::VioCopy);
 
-		model = myChevron.getMatrix();
-		glUniformMatrix4fv(myModelViewUniform, 1, GL_FALSE, (model * view).matrix);
+			if (samples > 1)
+			{
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, myFieldTarget.getFBO());
+				glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fieldRead);
+				glBlitFramebuffer(0, 0, width, fieldHeight, 0, 0, width, fieldHeight,
+									GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			}
 
-		myChevron.bindVAO();
+			// Interleaved buffers hold both fields, so every other line belongs
+			// to this field
+			unsigned char *dest = frame.ColorBuffer;
+			int rowLength = frame.ColorStride / 4;
+			int lines = fieldHeight;
+			if (interlace == 1)
+			{
+				if (frame.Lines > 0 && frame.Lines < lines)
+					lines = frame.Lines;
+			}
+			else
+			{
+				dest += field * frame.ColorStride;
+				rowLength *= 2;
+			}
 
-		glDrawArrays(GL_TRIANGLES, 0, myChevron.getElementCount() / 3);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, fieldRead);
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			glPixelStorei(GL_PACK_ROW_LENGTH, rowLength);
+			glReadPixels(0, 0, width, lines, GL_RGBA, GL_UNSIGNED_BYTE, dest);
+			glPixelStorei(GL_PACK_ROW_LENGTH, 0);
 
-		// Tidy up
+			myTimer.end();
 
-		glBindVertexArray(0);
-		glUseProgram(0);
+			unlockFrame(VioHandle);
+		}
 
-		//VERR(vUnlockFrame(VioHandle));
+		// Show the last field in the TOP itself
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fieldRead);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->getFBOIndex());
+		glBlitFramebuffer(0, 0, width, fieldHeight, 0, height, width, 0,
+							GL_COLOR_BUFFER_BIT, GL_LINEAR);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 	}
+	else
+	{
+		// Locking late leaves any wait on Ventuz until the scene is queued.
+		// A skipped cook still draws, only nothing goes out.
+		bool lockLate = genlock && myPacer.getLockLate();
+		vFrame keyFrame;
+		bool keyLocked = false;
+		bool locked = sends > 0 && !lockLate &&
+						lockFrames(&frame, &keyFrame, fillKey, deferredFill, &keyLocked);
+
+		// With fill and key both attachments are drawn in the same pass.
+		// TouchDesigner's second buffer gets the key whether or not the key
+		// stream is open, fillKey only decides what is sent.
+		const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+		int numDrawBuffers = outputFormat->numColorBuffers >= 2 ? 2 : 1;
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->getFBOIndex());
+		glDrawBuffers(numDrawBuffers, drawBuffers);
+
+		if (sceneDirty)
+		{
+			GLState::viewport(0, 0, width, height);
+			drawScene(view, myRotation, scene);
 
-	//context->endGLCommands();
+			// Keep the frame so idle cooks can resubmit it without drawing.
+			// Blits between multisampled buffers need matching sample counts.
+			if (redrawOnChange && programReady && sceneSteady)
+			{
+				myCacheTarget.setup(width, height, samples);
+				blitAttachment(context->getFBOIndex(), GL_COLOR_ATTACHMENT0,
+								myCacheTarget.getFBO(), GL_COLOR_ATTACHMENT0, width, height);
+				if (numDrawBuffers == 2)
+				{
+					myKeyCacheTarget.setup(width, height, samples);
+					blitAttachment(context->getFBOIndex(), GL_COLOR_ATTACHMENT1,
+									myKeyCacheTarget.getFBO(), GL_COLOR_ATTACHMENT0, width, height);
+				}
+
+				myCachedScene = scene;
+				myCacheValid = true;
+			}
+			else
+			{
+				// An older frame mustn't stand in for this one
+				myCacheValid = false;
+			}
+		}
+		else
+		{
+			blitAttachment(myCacheTarget.getFBO(), GL_COLOR_ATTACHMENT0,
+							context->getFBOIndex(), GL_COLOR_ATTACHMENT0, width, height);
+			if (numDrawBuffers == 2)
+			{
+				blitAttachment(myKeyCacheTarget.getFBO(), GL_COLOR_ATTACHMENT0,
+								context->getFBOIndex(), GL_COLOR_ATTACHMENT1, width, height);
+			}
+			myIdleCount++;
+		}
+
+		// Leave TouchDesigner's framebuffer drawing to all its attachments
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, context->getFBOIndex());
+		glDrawBuffers(numDrawBuffers, drawBuffers);
+
+		if (sends > 0 && lockLate)
+			locked = lockFrames(&frame, &keyFrame, fillKey, deferredFill, &keyLocked);
+
+		if (locked)
+		{
+			sendFrames(&frame, &keyFrame, keyLocked, deferredFill, context->getFBOIndex(),
+						width, height, samples);
+
+			// A repeat sends the same picture again as the following frame
+			if (sends > 1 && lockFrames(&frame, &keyFrame, fillKey, deferredFill, &keyLocked))
+			{
+				sendFrames(&frame, &keyFrame, keyLocked, deferredFill, context->getFBOIndex(),
+							width, height, samples);
+			}
+		}
+	}
+
+	myTimer.endFrame();
+
+	GLState::restore();
+	context->endGLCommands();
 }
 
 int32_t
 VioTOP::getNumInfoCHOPChans(void * reserved1)
 {
 	// We return the number of channel we want to output to any Info CHOP
-	// connected to the TOP. In this example we are just going to send one channel.
-	return 2;
+	// connected to the TOP. Along with the execute count and rotation we
+	// publish the GPU time taken by each phase of the last measured frame.
+	// Then the anc sent with the frame and, in receive mode, the anc values
+	// that came with it.
+	// The CPU time spent inside VIO calls comes last before those.
+	// The number of cooks that reused the cached frame comes next, then
+	// the instances and draw calls of the last drawn scene, and how often
+	// a geometry upload had to wait for the GPU. The program cache's hit
+	// rate and the build time it saved follow, then how many state changes
+	// GLState issued and skipped in total. Genlock's phase error, the
+	// frames it skipped and repeated, how long locking waited and the
+	// frames Ventuz dropped close the list.
+	return 2 + GpuTimer::NumPhases + 16 + myAncTable.getNumChannels();
 }
 
 void
 VioTOP::getInfoCHOPChan(int32_t index, OP_InfoCHOPChan* chan, void * reserved1)
 {
 	// This function will be called once for each channel we said we'd want to return
-	// In this example it'll only be called once.
 
 	if (index == 0)
 	{
@@ -327,12 +951,125 @@ VioTOP::getInfoCHOPChan(int32_t index, OP_InfoCHOPChan* chan, void * reserved1)
 		chan->name->setString("rotation");
 		chan->value = (float)myRotation;
 	}
+
+	if (index >= 2 && index < 2 + GpuTimer::NumPhases)
+	{
+		GpuTimer::Phase phase = static_cast<GpuTimer::Phase>(index - 2);
+		chan->name->setString(GpuTimer::getPhaseName(phase));
+		chan->value = (float)myTimer.getMilliseconds(phase);
+	}
+
+	if (index == 2 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("ancSentBytes");
+		chan->value = (float)myAncWriter.getNumBytes();
+	}
+
+	if (index == 3 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("ancSentBlobs");
+		chan->value = (float)myAncWriter.getNumBlobs();
+	}
+
+	if (index == 4 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("vioCpuMs");
+		chan->value = (float)myVioMilliseconds;
+	}
+
+	if (index == 5 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("idleCooks");
+		chan->value = (float)myIdleCount;
+	}
+
+	if (index == 6 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("sceneInstances");
+		chan->value = (float)myScene.getNumInstances();
+	}
+
+	if (index == 7 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("sceneDraws");
+		chan->value = (float)myScene.getNumDraws();
+	}
+
+	if (index == 8 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("geometryRingWaits");
+		chan->value = (float)myGeometry.getRingWaits();
+	}
+
+	if (index == 9 + GpuTimer::NumPhases)
+	{
+		int lookups = ProgramCache::getLookups();
+		chan->name->setString("programCacheHitRate");
+		chan->value = lookups > 0 ? (float)ProgramCache::getHits() / lookups : 0.0f;
+	}
+
+	if (index == 10 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("programCacheSavedMs");
+		chan->value = (float)ProgramCache::getMillisecondsSaved();
+	}
+
+	if (index == 11 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("glStateIssued");
+		chan->value = (float)GLState::getIssued();
+	}
+
+	if (index == 12 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("glStateSkipped");
+		chan->value = (float)GLState::getSkipped();
+	}
+
+	if (index == 13 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("genlockPhase");
+		chan->value = (float)myPacer.getPhaseError();
+	}
+
+	if (index == 14 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("genlockSkipped");
+		chan->value = (float)myPacer.getSkipped();
+	}
+
+	if (index == 15 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("genlockRepeated");
+		chan->value = (float)myPacer.getRepeated();
+	}
+
+	if (index == 16 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("genlockLockWaitMs");
+		chan->value = (float)myPacer.getLockWaitMilliseconds();
+	}
+
+	if (index == 17 + GpuTimer::NumPhases)
+	{
+		chan->name->setString("ventuzDrops");
+		chan->value = (float)myPacer.getVentuzDrops();
+	}
+
+	if (index >= 18 + GpuTimer::NumPhases)
+	{
+		const char *name = "";
+		float value = 0.0f;
+		myAncTable.getChannel(index - 18 - GpuTimer::NumPhases, &name, &value);
+		chan->name->setString(name);
+		chan->value = value;
+	}
 }
 
 bool		
 VioTOP::getInfoDATSize(OP_InfoDATSize* infoSize, void* reserved1)
 {
-	infoSize->rows = 2;
+	infoSize->rows = 3;
 	infoSize->cols = 2;
 	// Setting this to false means we'll be assigning values to the table
 	// one row at a time. True means we'll do it one column at a time.
@@ -385,10 +1122,46 @@ VioTOP::getInfoDATEntries(int32_t index,
 #endif
 		entries->values[1]->setString(tempBuffer);
 	}
+
+	if (index == 2)
+	{
+		// The log can be longer than tempBuffer, it's set straight from
+		// the copy taken when the build finished
+		entries->values[0]->setString("shaderLog");
+		entries->values[1]->setString(myShaderLog.c_str());
+	}
 }
 
 void
-VioTOP::getErrorString(OP_String *error, void* reserved1)
+VioTOP::getWarningString(OP_String *warning, void* reserved1)
+{
+	if (myAncWriter.getNumDropped() > 0)
+	{
+		warning->setString(ancOverflowWarning);
+	}
+	else if (myKeyMissing)
+	{
+		warning->setString(keyWarning);
+	}
+	else if (myProgram && !myShaderError.empty())
+	{
+		// Without a program the failed build is reported as the error
+		warning->setString(shaderWarning);
+	}
+	else if (myVertexSource.getError() || myFragmentSource.getError())
+	{
+		warning->setString(myVertexSource.getError() ? myVertexSource.getError() : myFragmentSource.getError());
+	}
+	else if (myUniforms.getUnbound()[0])
+	{
+		std::string unbound = "No value for the uniforms: ";
+		unbound.append(myUniforms.getUnbound());
+		warning->setString(unbound.c_str());
+	}
+}
+
+void
+VioTOP::getErrorString(OP_String *error, void* reserved1)
 {
 	error->setString(myError);
 }
@@ -460,6 +1233,325 @@ VioTOP::setupParameters(OP_ParameterManager* manager, void* reserved1)
 		assert(res == OP_ParAppendResult::Success);
 	}
 
+	// geometry drawn into the output, straight from a SOP
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Geometrysop";
+		sp.label = "Geometry SOP";
+
+		OP_ParAppendResult res = manager->appendSOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Geometrycolor";
+		np.label = "Geometry Color";
+
+		for (int i=0; i<3; i++)
+		{
+			np.defaultValues[i] = 1.0;
+			np.minValues[i] = 0.0;
+			np.maxValues[i] = 1.0;
+			np.minSliders[i] = 0.0;
+			np.maxSliders[i] = 1.0;
+			np.clampMins[i] = true;
+			np.clampMaxes[i] = true;
+		}
+
+		OP_ParAppendResult res = manager->appendRGB(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// shaders replacing the built-in ones, from a DAT or else a file. They
+	// are rebuilt whenever the DAT cooks or the file is saved.
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Vertexdat";
+		sp.label = "Vertex Shader DAT";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Vertexfile";
+		sp.label = "Vertex Shader File";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Fragmentdat";
+		sp.label = "Fragment Shader DAT";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Fragmentfile";
+		sp.label = "Fragment Shader File";
+
+		OP_ParAppendResult res = manager->appendFile(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// values for the uValue1 to uValue4 uniforms of the shaders
+	for (int i = 0; i < 4; i++)
+	{
+		OP_NumericParameter	np;
+
+		const char *names[] = { "Value1", "Value2", "Value3", "Value4" };
+		const char *labels[] = { "Value 1", "Value 2", "Value 3", "Value 4" };
+		np.name = names[i];
+		np.label = labels[i];
+
+		for (int j = 0; j < 4; j++)
+		{
+			np.minSliders[j] = 0.0;
+			np.maxSliders[j] = 1.0;
+		}
+
+		OP_ParAppendResult res = manager->appendFloat(np, 4);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// mode
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Mode";
+		sp.label = "Mode";
+		sp.defaultValue = "Send";
+
+		const char *names[] = { "Send", "Receive" };
+		const char *labels[] = { "Send to Ventuz", "Receive from Ventuz" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 2, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// custom anc codes to receive, besides the camera and projection
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Ancfourccs";
+		sp.label = "Anc FOURCCs";
+		sp.defaultValue = "";
+
+		OP_ParAppendResult res = manager->appendString(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// interlaced output
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Interlace";
+		sp.label = "Interlace";
+		sp.defaultValue = "Off";
+
+		const char *names[] = { "Off", "Fields", "Interleaved" };
+		const char *labels[] = { "Off", "Field by Field", "Interleaved" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 3, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// multisampling, the output is resolved when it's copied to VIO
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Antialias";
+		sp.label = "Antialias";
+		sp.defaultValue = "1";
+
+		const char *names[] = { "1", "2", "4", "8" };
+		const char *labels[] = { "Off", "2x", "4x", "8x" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 4, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// fill on the stream's channel and key, from alpha, on the next one
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fillkey";
+		np.label = "Fill and Key";
+		np.defaultValues[0] = 0.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// alpha conversion, applied as frames are drawn or received
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Alphamode";
+		sp.label = "Alpha";
+		sp.defaultValue = "Off";
+
+		const char *names[] = { "Off", "Premultiply", "Unpremultiply", "Invert", "Key" };
+		const char *labels[] = { "Off", "Premultiply", "Unpremultiply", "Invert Alpha", "Alpha to Key" };
+
+		OP_ParAppendResult res = manager->appendMenu(sp, 5, names, labels);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// only draw the scene when something changed, otherwise resubmit the
+	// last frame
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Redrawonchange";
+		np.label = "Redraw Only On Change";
+		np.defaultValues[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// deferred fill, lock without filling and fill once the scene is queued
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Deferredfill";
+		np.label = "Deferred Fill";
+		np.defaultValues[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// genlock, skip or repeat frames to follow a synchronous stream's clock
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Genlock";
+		np.label = "Genlock To Ventuz";
+		np.defaultValues[0] = 0.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// anc sources, sent with every frame
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Ancchop";
+		sp.label = "Anc CHOP";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Ancdat";
+		sp.label = "Anc DAT";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// send camera
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Sendcamera";
+		np.label = "Send Camera";
+		np.defaultValues[0] = 0.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// camera
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Camera";
+		sp.label = "Camera";
+
+		OP_ParAppendResult res = manager->appendObject(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// origin, the camera is sent relative to this object when set
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Origin";
+		sp.label = "Origin";
+
+		OP_ParAppendResult res = manager->appendObject(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// field of view
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Fov";
+		np.label = "FOV";
+		np.defaultValues[0] = 45.0;
+		np.minValues[0] = 1.0;
+		np.maxValues[0] = 179.0;
+		np.minSliders[0] = 1.0;
+		np.maxSliders[0] = 179.0;
+		np.clampMins[0] = true;
+		np.clampMaxes[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// near / far
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Near";
+		np.label = "Near";
+		np.defaultValues[0] = 0.1;
+		np.minValues[0] = 0.0001;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 10.0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Far";
+		np.label = "Far";
+		np.defaultValues[0] = 1000.0;
+		np.minValues[0] = 0.001;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1000.0;
+		np.clampMins[0] = true;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
 	// pulse
 	{
 		OP_NumericParameter	np;
@@ -482,60 +1574,345 @@ VioTOP::pulsePressed(const char* name, void* reserved1)
 	}
 }
 
-void VioTOP::setupGL()
+// VIO works in our context, so each call into it gets the bindings back
+// at 0 and leaves whatever it set unknown to GLState
+
+bool
+VioTOP::lockFrame(vHandle &handle, vFrame *frame, vLockFlags flags)
 {
-	if (myDidSetup == false)
+	GLState::restore();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	vError error = vLockFrameEx2(handle, frame, flags);
+	GLState::invalidate();
+	myVioMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (!VERR(error))
 	{
-		myError = myProgram.build(vertexShader, fragmentShader);
+		if (error == VE_ConnectionBroken)
+			handle = 0;
+		return false;
+	}
+	return true;
+}
 
-		// If an error occurred creating myProgram, we can't proceed
-		if (myError == nullptr)
-		{
-			GLint vertAttribLocation = glGetAttribLocation(myProgram.getName(), "P");
-			myModelViewUniform = glGetUniformLocation(myProgram.getName(), "uModelView");
-			myColorUniform = glGetUniformLocation(myProgram.getName(), "uColor");
+void
+VioTOP::fillBuffers(vHandle handle, vFrame *frame)
+{
+	GLState::restore();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	VERR(vFillBuffers(handle, frame));
+	GLState::invalidate();
+	myVioMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-			if (vertAttribLocation == -1 || myModelViewUniform == -1 || myColorUniform == -1)
-			{
-				myError = uniformError;
-			}
+void
+VioTOP::fillBuffersEnd(vHandle handle)
+{
+	GLState::restore();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	VERR(vFillBuffersEnd(handle));
+	GLState::invalidate();
+	myVioMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-			// Set up our two shapes
-			GLfloat square[] = {
-				-0.5, -0.5, 1.0,
-				0.5, -0.5, 1.0,
-				-0.5,  0.5, 1.0,
+void
+VioTOP::unlockFrame(vHandle &handle)
+{
+	GLState::restore();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	vError error = vUnlockFrame(handle);
+	GLState::invalidate();
+	myVioMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (!VERR(error) && error == VE_ConnectionBroken)
+		handle = 0;
+}
 
-				0.5, -0.5, 1.0,
-				0.5,  0.5, 1.0,
-				-0.5,  0.5, 1.0
-			};
+// Locks the frame, and the key's alongside it, and hands the anc to VIO
 
-			mySquare.setVertices(square, 2 * 9);
-			mySquare.setup(vertAttribLocation);
+bool
+VioTOP::lockFrames(vFrame *frame, vFrame *keyFrame, bool fillKey, bool deferredFill, bool *keyLocked)
+{
+	vLockFlags flags = deferredFill ? VLF_None : VLF_FillBuffers;
 
-			GLfloat chevron[] = {
-				-1.0, -1.0,  1.0,
-				-0.5,  0.0,  1.0,
-				0.0, -1.0,  1.0,
+	// A synchronous stream blocks here until Ventuz takes the frame, the
+	// pacer places the lock by how long that takes
+	double before = myVioMilliseconds;
+	if (!lockFrame(VioHandle, frame, flags))
+		return false;
+	myPacer.frameLocked(*frame, myVioMilliseconds - before);
 
-				-0.5,  0.0,  1.0,
-				0.5,  0.0,  1.0,
-				0.0, -1.0,  1.0,
+	VERR(myAncWriter.submit(VioHandle));
 
-				0.0,  1.0,  1.0,
-				0.5,  0.0,  1.0,
-				-0.5,  0.0,  1.0,
+	// The key stream's frame goes out alongside the fill's
+	*keyLocked = fillKey && lockFrame(myKeyHandle, keyFrame, flags);
+	return true;
+}
 
-				-1.0,  1.0,  1.0,
-				0.0,  1.0,  1.0,
-				-0.5,  0.0,  1.0
-			};
+void
+VioTOP::sendFrames(vFrame *frame, vFrame *keyFrame, bool keyLocked, bool deferredFill, GLuint fbo,
+					int width, int height, int samples)
+{
+	// With a deferred fill the buffers are only filled once the scene has
+	// been queued, so VIO's transfer overlaps with our rendering instead of
+	// being serialized in front of it. The buffers can't be touched until
+	// they are filled, so the copy comes after vFillBuffers.
+	if (deferredFill)
+	{
+		fillBuffers(VioHandle, frame);
+		if (keyLocked)
+			fillBuffers(myKeyHandle, keyFrame);
+	}
 
-			myChevron.setVertices(chevron, 4 * 9);
-			myChevron.setup(vertAttribLocation);
-		}
+	// Copy the rendered frame into the Ventuz texture, and the key into
+	// the key stream's
+
+	myTimer.begin(GpuTimer::VioCopy);
+
+	copyToVio(fbo, GL_COLOR_ATTACHMENT0, frame->GlColorName, width, height, samples);
+	if (keyLocked)
+		copyToVio(fbo, GL_COLOR_ATTACHMENT1, keyFrame->GlColorName, width, height, samples);
+
+	myTimer.end();
+
+	if (deferredFill)
+	{
+		fillBuffersEnd(VioHandle);
+		if (keyLocked)
+			fillBuffersEnd(myKeyHandle);
+	}
+
+	if (keyLocked)
+		unlockFrame(myKeyHandle);
+	unlockFrame(VioHandle);
+}
+
+void
+VioTOP::copyToVio(GLuint fbo, GLenum attachment, GLuint texture, int width, int height, int samples)
+{
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glReadBuffer(attachment);
+	if (samples > 1)
+	{
+		// Can't copy out of a multisampled buffer, a blit resolves it
+		// straight into the VIO texture instead
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, myVioFBO);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+							GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+	}
+	else
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+}
+
+void
+VioTOP::drawScene(const Matrix &view, double rotation, const SceneParameters &scene)
+{
+	myTimer.begin(GpuTimer::Clear);
+	GLState::clearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	myTimer.end();
+
+	if (!myProgram)
+		return;
+
+	// Build the scene, the square first so the chevron is drawn over it
+
+	myScene.begin();
+
+	mySquare.setTranslate(0.5f, 0.5f);
+	mySquare.setRotation(static_cast<GLfloat>(rotation));
+
+	mySquareTransforms.resize(1);
+	mySquare.getTransform(mySquareTransforms, 0);
+
+	GLfloat color[4] = { static_cast<GLfloat>(scene.color1[0]), static_cast<GLfloat>(scene.color1[1]), static_cast<GLfloat>(scene.color1[2]), 1.0f };
+	myScene.add(&mySquare, mySquareTransforms, color);
+
+	myChevron.setScale(0.8f, 0.8f);
+	myChevron.setTranslate(-0.5, -0.5);
+	myChevron.setRotation(static_cast<GLfloat>(rotation));
+
+	myChevronTransforms.resize(1);
+	myChevron.getTransform(myChevronTransforms, 0);
+
+	color[0] = static_cast<GLfloat>(scene.color2[0]);
+	color[1] = static_cast<GLfloat>(scene.color2[1]);
+	color[2] = static_cast<GLfloat>(scene.color2[2]);
+	myScene.add(&myChevron, myChevronTransforms, color);
+
+	// The SOP's geometry is drawn on top, untransformed
+	if (myGeometry.getIndexCount() > 0)
+	{
+		color[0] = static_cast<GLfloat>(scene.geometryColor[0]);
+		color[1] = static_cast<GLfloat>(scene.geometryColor[1]);
+		color[2] = static_cast<GLfloat>(scene.geometryColor[2]);
+		myScene.add(&myGeometry, Matrix(), color);
+	}
+
+	// Draw it
+
+	myTimer.begin(GpuTimer::DrawScene);
+
+	// Everything shared by the whole draw goes up in one update
+	FrameConstants constants;
+	memcpy(constants.view, view.matrix, sizeof(constants.view));
+	// glBindBufferBase() also binds the generic target, to the same buffer
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, myFrameUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(constants), &constants);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameBinding, myFrameUBO);
+
+	GLState::useProgram(myProgram->getName());
+
+	myUniforms.set(UniformTable::Rotation, rotation);
+	myUniforms.set(UniformTable::Resolution, scene.width, scene.height);
+	myUniforms.set(UniformTable::Color1, scene.color1[0], scene.color1[1], scene.color1[2]);
+	myUniforms.set(UniformTable::Color2, scene.color2[0], scene.color2[1], scene.color2[2]);
+	myUniforms.set(UniformTable::GeometryColor, scene.geometryColor[0], scene.geometryColor[1],
+					scene.geometryColor[2]);
+	for (int i = 0; i < 4; i++)
+	{
+		myUniforms.set(static_cast<UniformTable::Source>(UniformTable::Value1 + i), scene.values[i][0],
+						scene.values[i][1], scene.values[i][2], scene.values[i][3]);
+	}
+	myUniforms.set(UniformTable::AlphaMode, scene.alphaMode);
+	myUniforms.apply();
+
+	myScene.draw();
+
+	myTimer.end();
+}
+
+void VioTOP::setupGL()
+{
+	if (myDidSetup == false)
+	{
+		// Set up our two shapes
+		GLfloat square[] = {
+			-0.5, -0.5, 1.0,
+			0.5, -0.5, 1.0,
+			-0.5,  0.5, 1.0,
+
+			0.5, -0.5, 1.0,
+			0.5,  0.5, 1.0,
+			-0.5,  0.5, 1.0
+		};
+
+		// The vertex data is shared between nodes, the VAOs are not
+		mySquare.share(SharedRegistry::getShape(square, 2 * 9));
+		mySquare.setup(PositionAttrib);
+
+		GLfloat chevron[] = {
+			-1.0, -1.0,  1.0,
+			-0.5,  0.0,  1.0,
+			0.0, -1.0,  1.0,
+
+			-0.5,  0.0,  1.0,
+			0.5,  0.0,  1.0,
+			0.0, -1.0,  1.0,
+
+			0.0,  1.0,  1.0,
+			0.5,  0.0,  1.0,
+			-0.5,  0.0,  1.0,
+
+			-1.0,  1.0,  1.0,
+			0.0,  1.0,  1.0,
+			-0.5,  0.0,  1.0
+		};
+
+		myChevron.share(SharedRegistry::getShape(chevron, 4 * 9));
+		myChevron.setup(PositionAttrib);
+		// SOP geometry is re-uploaded whenever the SOP cooks
+		myGeometry.setDynamic(true);
+		myGeometry.setup(PositionAttrib);
+
+		myScene.setup(ModelAttrib, ColorAttrib);
+
+		myTimer.setup();
+
+		glGenFramebuffers(1, &myVioFBO);
+
+		// The copy draws without attributes, but core profile still needs a
+		// VAO bound. The sampler leaves the VIO texture's own state alone.
+		myCopyProgram = SharedRegistry::getProgram(copyVertexShader, copyFragmentShader);
+		glGenVertexArrays(1, &myCopyVAO);
+		glGenSamplers(1, &myCopySampler);
+		glSamplerParameteri(myCopySampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glSamplerParameteri(myCopySampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glSamplerParameteri(myCopySampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glSamplerParameteri(myCopySampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenBuffers(1, &myFrameUBO);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, myFrameUBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), nullptr, GL_DYNAMIC_DRAW);
 
 		myDidSetup = true;
 	}
 }
+
+bool
+VioTOP::pollCopyProgram()
+{
+	// Until it's ready, or if it failed, received frames are blitted
+	// without converting
+	if (!myCopyReady && myCopyProgram->poll() == Program::Ready)
+	{
+		myCopyUniforms.reflect(myCopyProgram->getName());
+		myCopyReady = true;
+	}
+	return myCopyReady;
+}
+
+void
+VioTOP::submitProgram()
+{
+	// Builds in the background, see pollProgram(). A pending build of
+	// older sources is simply dropped.
+	myPendingProgram = SharedRegistry::getProgram(myVertexSource.getText(), myFragmentSource.getText());
+	myShaderChanged = false;
+}
+
+bool
+VioTOP::pollProgram()
+{
+	if (myPendingProgram)
+	{
+		Program::State state = myPendingProgram->poll();
+		// The error and log are copied once, they outlive the program
+		if (state == Program::Failed)
+		{
+			myShaderError = myPendingProgram->getError();
+			myShaderLog = myPendingProgram->getLog();
+			myPendingProgram.reset();
+		}
+		else if (state == Program::Ready)
+		{
+			GLuint name = myPendingProgram->getName();
+			myShaderLog = myPendingProgram->getLog();
+
+			// The linker drops a Frame block the shaders never read, then
+			// there is simply nothing to bind
+			GLuint frameBlock = glGetUniformBlockIndex(name, "Frame");
+			if (frameBlock != GL_INVALID_INDEX)
+				glUniformBlockBinding(name, frameBlock, FrameBinding);
+
+			// Uniforms are looked up once here rather than every draw
+			myUniforms.reflect(name);
+
+			myProgram = myPendingProgram;
+			myShaderError.clear();
+
+			// The cached frame was drawn with the old shaders
+			myCacheValid = false;
+			myPendingProgram.reset();
+		}
+	}
+	return myProgram != nullptr;
+}
@@ -14,8 +14,51 @@
 
 #include "TOP_CPlusPlusBase.h"
 #include "Program.h"
+#include "SharedRegistry.h"
 #include "Shape.h"
+#include "SceneRenderer.h"
+#include "GpuTimer.h"
+#include "AncTable.h"
+#include "AncWriter.h"
+#include "RenderTarget.h"
+#include "ShaderSource.h"
+#include "UniformTable.h"
+#include "FramePacer.h"
 #include "inc/VioApi.h"
+#include <cstring>
+
+// Everything the drawn scene depends on, so a cook can tell whether the
+// last drawn frame is still current
+struct SceneParameters
+{
+	double	rotation;
+	double	color1[3];
+	double	color2[3];
+	double	geometryColor[3];
+	double	values[4][4];
+	int		width;
+	int		height;
+	int		samples;
+	int		colorBuffers;
+	int		alphaMode;
+
+	// Identifies the geometry SOP and which of its cooks was drawn
+	uint32_t	geometryId;
+	int64_t		geometryCooks;
+
+	bool operator==(const SceneParameters &other) const
+	{
+		return rotation == other.rotation &&
+			color1[0] == other.color1[0] && color1[1] == other.color1[1] && color1[2] == other.color1[2] &&
+			color2[0] == other.color2[0] && color2[1] == other.color2[1] && color2[2] == other.color2[2] &&
+			geometryColor[0] == other.geometryColor[0] && geometryColor[1] == other.geometryColor[1] &&
+			geometryColor[2] == other.geometryColor[2] &&
+			memcmp(values, other.values, sizeof(values)) == 0 &&
+			width == other.width && height == other.height && samples == other.samples &&
+			colorBuffers == other.colorBuffers && alphaMode == other.alphaMode &&
+			geometryId == other.geometryId && geometryCooks == other.geometryCooks;
+	}
+};
 
 class VioTOP : public TOP_CPlusPlusBase
 {
@@ -43,6 +86,7 @@ public:
 											OP_InfoDATEntries *entries,
 											void* reserved1) override;
 
+	virtual void		getWarningString(OP_String *warning, void* reserved1) override;
 	virtual void		getErrorString(OP_String *error, void* reserved1) override;
 
 	virtual void		setupParameters(OP_ParameterManager *manager, void* reserved1) override;
@@ -50,6 +94,23 @@ public:
 
 private:
 	void                setupGL();
+	void				submitProgram();
+	bool				pollCopyProgram();
+	bool				pollProgram();
+	bool				lockFrame(VioApi::vHandle &handle, VioApi::vFrame *frame,
+								VioApi::vLockFlags flags);
+	void				fillBuffers(VioApi::vHandle handle, VioApi::vFrame *frame);
+	void				fillBuffersEnd(VioApi::vHandle handle);
+	void				unlockFrame(VioApi::vHandle &handle);
+	bool				lockFrames(VioApi::vFrame *frame, VioApi::vFrame *keyFrame,
+								bool fillKey, bool deferredFill, bool *keyLocked);
+	void				sendFrames(VioApi::vFrame *frame, VioApi::vFrame *keyFrame,
+								bool keyLocked, bool deferredFill, GLuint fbo,
+								int width, int height, int samples);
+	void				copyToVio(GLuint fbo, GLenum attachment, GLuint texture,
+								int width, int height, int samples);
+	void				drawScene(const Matrix &view, double rotation,
+								const SceneParameters &scene);
 	// We don't need to store this pointer, but we do for the example.
 	// The OP_NodeInfo class store information about the node that's using
 	// this instance of the class (like its name).
@@ -62,16 +123,79 @@ private:
 
 	const char*			myError;
 
-	Program				myProgram;
+	// Shared with every other node using the same sources. A rebuilt
+	// program stays pending until it has linked, the last one that did
+	// keeps drawing meanwhile.
+	ShaderSource		myVertexSource;
+	ShaderSource		myFragmentSource;
+	bool				myShaderChanged;
+	std::shared_ptr<Program>	myProgram;
+	std::shared_ptr<Program>	myPendingProgram;
+	// What went wrong with the last build, and its compiler log
+	std::string			myShaderError;
+	std::string			myShaderLog;
+	UniformTable		myUniforms;
 	Shape				mySquare;
 	Shape				myChevron;
+	SceneRenderer		myScene;
+	// Each shape's instances, evaluated into matrices in one pass
+	TransformBatch		mySquareTransforms;
+	TransformBatch		myChevronTransforms;
+
+	// Geometry from the Geometry SOP, uploaded when the SOP cooks
+	Shape				myGeometry;
+	uint32_t			myGeometryId;
+	int64_t				myGeometryCooks;
+
+	GpuTimer			myTimer;
 
 	bool				myDidSetup;
 
-	GLint				myModelViewUniform;
-	GLint				myColorUniform;
+	// Per-frame shader constants, the Frame uniform block
+	GLuint				myFrameUBO;
+
+	// Converts alpha while copying received frames into the output
+	std::shared_ptr<Program>	myCopyProgram;
+	bool				myCopyReady;
+	UniformTable		myCopyUniforms;
+	GLuint				myCopyVAO;
+	GLuint				myCopySampler;
+
+	// Anc sent with, or received with, the current frame
+	AncWriter			myAncWriter;
+	AncTable			myAncTable;
+
+	// CPU time spent inside VIO calls during the last cook
+	double				myVioMilliseconds;
+
+	// Used to read the Ventuz texture when receiving
+	GLuint				myVioFBO;
+
+	// Half height target fields are rendered into for interlaced output,
+	// and the target a multisampled field is resolved into
+	RenderTarget		myFieldTarget;
+	RenderTarget		myFieldResolve;
+
+	// The last drawn frame, resubmitted while the scene doesn't change
+	RenderTarget		myCacheTarget;
+	RenderTarget		myKeyCacheTarget;
+	SceneParameters		myCachedScene;
+	// The previous cook's snapshot, a scene is only cached once it repeats
+	SceneParameters		myLastScene;
+	bool				myCacheValid;
+	int32_t				myIdleCount;
+
+	// Skips or repeats frames to stay in step with a synchronous stream
+	FramePacer			myPacer;
 
 	VioApi::vHandle VioHandle;
+	// Carries the key when sending fill and key, on the next channel
+	VioApi::vHandle myKeyHandle;
+	// Set while Fill and Key is on but the key stream didn't open, which
+	// is only tried again every KeyReopenCooks cooks
+	bool myKeyMissing;
+	int32_t myKeyRetryCooks;
 	VioApi::vOpenPara OpenPara;
+	VioApi::vInfo myStreamInfo;
 
 };